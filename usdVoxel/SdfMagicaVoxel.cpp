@@ -1,5 +1,10 @@
+#include "pxr/pxr.h"
 #include "pxr/base/gf/vec3f.h"
 #include "pxr/base/gf/matrix4f.h"
+#include "pxr/base/gf/quatf.h"
+#include "pxr/base/gf/quath.h"
+#include "pxr/base/tf/envSetting.h"
+#include "pxr/base/tf/stringUtils.h"
 #include "pxr/base/tf/refPtr.h"
 #include "pxr/base/tf/token.h"
 #include "pxr/base/tf/weakPtr.h"
@@ -9,6 +14,7 @@
 #include "pxr/usd/sdf/path.h"
 #include "pxr/usd/sdf/reference.h"
 #include "pxr/usd/sdf/abstractData.h"
+#include "pxr/usd/sdf/copyUtils.h"
 #include "pxr/usd/sdf/fileFormat.h"
 #include "pxr/usd/sdf/layer.h"
 #include "pxr/base/tf/registryManager.h"
@@ -23,29 +29,145 @@
 #include "ogt_vox.h"
 
 #include "cubePlacers.h"
+#include "meshCache.h"
+#include "meshChunks.h"
+#include "readOptions.h"
+#include "voxelHash.h"
+#include "voxelExterior.h"
+#include "voxelOrientation.h"
+#include "voxelPipeline.h"
+#include "voxelRepresentation.h"
+#include "voxelSet.h"
+#include "voxAssetReader.h"
 
+#include <algorithm>
+#include <float.h>
+#include <functional>
 #include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 using namespace pxr;
 
+// How many models may be meshed ahead of the one whose specs are being written.
+static const size_t k_pipeline_window = 8;
+
+TF_DEFINE_ENV_SETTING(USDVOXEL_READ_BUDGET_MB, 0,
+                      "If not 0, .vox files are converted in streaming mode: models are decoded one at a time, "
+                      "and the memory used by models being decoded and meshed is kept within this many megabytes.");
+
+template <class T>
+static void MagicavoxelPlaceVoxel(const ogt_vox_palette *palette, uint32_t x, uint32_t y, uint32_t z, uint8_t color_index, uint8_t sides, T &cubePlacer) {
+    ogt_vox_rgba color = palette->color[color_index];
+    float r = (float)color.r / 255.0f;
+    float g = (float)color.g / 255.0f;
+    float b = (float)color.b / 255.0f;
+    cubePlacer.place(x,y,z, r,g,b, sides);
+}
+
+// Key of a packed x,y,z,color_index voxel. Increases in the same x -> y -> z order as the dense grid.
+static inline uint32_t packedVoxelKey(uint32_t x, uint32_t y, uint32_t z) {
+    return x | (y << 8) | (z << 16);
+}
+
+// True if a face opening onto the empty cell at x,y,z can be seen: always, unless there's an exterior to check
+// (cullCavities=1) and the cell is sealed inside the model.
+static inline bool cellIsExterior(const VoxelExterior *exterior, int32_t x, int32_t y, int32_t z) {
+    return !exterior || exterior->contains(x, y, z);
+}
+
+// The empty cells reachable from outside a decoded model's grid.
+static VoxelExterior modelExterior(const ogt_vox_model *model) {
+    const int32_t lo[3] = { 0, 0, 0 };
+    const uint32_t size[3] = { model->size_x, model->size_y, model->size_z };
+    return VoxelExterior(lo, size, [&](auto visit) {
+        if (model->packed_voxel_data) {
+            for (uint32_t i = 0; i < model->num_packed_voxels; i++) {
+                const uint8_t *v = &model->packed_voxel_data[i * 4];
+                visit(v[0], v[1], v[2]);
+            }
+            return;
+        }
+        size_t voxel_index = 0;
+        for (uint32_t z = 0; z < model->size_z; z++) {
+        for (uint32_t y = 0; y < model->size_y; y++) {
+        for (uint32_t x = 0; x < model->size_x; x++, voxel_index++) {
+            if (model->voxel_data[voxel_index] != 0) {
+                visit(x, y, z);
+            }
+        }
+        }
+        }
+    });
+}
+
+// Meshes a sparse model straight from its packed voxel list, with a hashed neighbour lookup.
+// Time and memory scale with the voxel count rather than the bounding volume.
+template <class T>
+static bool MagicavoxelRead_SparseModel(const ogt_vox_model *model, const ogt_vox_palette *palette, const VoxelExterior *exterior, T &cubePlacer) {
+    const uint8_t *voxels = model->packed_voxel_data;
+    uint32_t count = model->num_packed_voxels;
+
+    VoxelKeySet solid(count);
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *v = &voxels[i * 4];
+        solid.insert(packedVoxelKey(v[0], v[1], v[2]));
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *v = &voxels[i * 4];
+        uint32_t x = v[0], y = v[1], z = v[2];
+        uint8_t sides = 0;
+        if (x == 0 || (!solid.contains(packedVoxelKey(x-1, y, z)) && cellIsExterior(exterior, x-1, y, z))) sides |= k_cube_side_left;
+        if (x+1 == model->size_x || (!solid.contains(packedVoxelKey(x+1, y, z)) && cellIsExterior(exterior, x+1, y, z))) sides |= k_cube_side_right;
+        if (z == 0 || (!solid.contains(packedVoxelKey(x, y, z-1)) && cellIsExterior(exterior, x, y, z-1))) sides |= k_cube_side_back;
+        if (z+1 == model->size_z || (!solid.contains(packedVoxelKey(x, y, z+1)) && cellIsExterior(exterior, x, y, z+1))) sides |= k_cube_side_front;
+        if (y+1 == model->size_y || (!solid.contains(packedVoxelKey(x, y+1, z)) && cellIsExterior(exterior, x, y+1, z))) sides |= k_cube_side_top;
+        if (y == 0 || (!solid.contains(packedVoxelKey(x, y-1, z)) && cellIsExterior(exterior, x, y-1, z))) sides |= k_cube_side_bottom;
+        if (sides != 0) {
+            MagicavoxelPlaceVoxel(palette, x, y, z, v[3], sides, cubePlacer);
+        }
+    }
+    return true;
+}
+
 template <class T> 
-static bool MagicavoxelRead_Model(const ogt_vox_model *model, const ogt_vox_palette *palette, T &cubePlacer) {
+static bool MagicavoxelRead_Model(const ogt_vox_model *model, const ogt_vox_palette *palette, bool cullCavities, T &cubePlacer) {
+    std::unique_ptr<VoxelExterior> exterior;
+    if (cullCavities) {
+        exterior.reset(new VoxelExterior(modelExterior(model)));
+    }
+    if (model->packed_voxel_data) {
+        return MagicavoxelRead_SparseModel(model, palette, exterior.get(), cubePlacer);
+    }
+
+    const uint8_t *grid = model->voxel_data;
+    const size_t stride_y = model->size_x;
+    const size_t stride_z = (size_t)model->size_x * model->size_y;
+
     for (uint32_t z = 0; z < model->size_z; z++) {
     for (uint32_t y = 0; y < model->size_y; y++) {
     for (uint32_t x = 0; x < model->size_x; x++) {
-        size_t voxel_index = x + (y * model->size_x) + (z * model->size_x * model->size_y);
-        uint8_t color_index = model->voxel_data[voxel_index];
+        size_t voxel_index = x + (y * stride_y) + (z * stride_z);
+        uint8_t color_index = grid[voxel_index];
         if (color_index != 0) {
-            // solid voxel
-            ogt_vox_rgba color = palette->color[color_index];
-            float r = (float)color.r / 255.0f;
-            float g = (float)color.g / 255.0f;
-            float b = (float)color.b / 255.0f;
-            float a = (float)color.a / 255.0f;
-            cubePlacer.place(x,y,z, r,g,b, 0xff);
+            // solid voxel. only emit the faces that aren't covered by a neighbour.
+            uint8_t sides = 0;
+            if (x == 0 || (!grid[voxel_index - 1] && cellIsExterior(exterior.get(), x-1, y, z))) sides |= k_cube_side_left;
+            if (x+1 == model->size_x || (!grid[voxel_index + 1] && cellIsExterior(exterior.get(), x+1, y, z))) sides |= k_cube_side_right;
+            if (z == 0 || (!grid[voxel_index - stride_z] && cellIsExterior(exterior.get(), x, y, z-1))) sides |= k_cube_side_back;
+            if (z+1 == model->size_z || (!grid[voxel_index + stride_z] && cellIsExterior(exterior.get(), x, y, z+1))) sides |= k_cube_side_front;
+            if (y+1 == model->size_y || (!grid[voxel_index + stride_y] && cellIsExterior(exterior.get(), x, y+1, z))) sides |= k_cube_side_top;
+            if (y == 0 || (!grid[voxel_index - stride_y] && cellIsExterior(exterior.get(), x, y-1, z))) sides |= k_cube_side_bottom;
+            if (sides != 0) {
+                MagicavoxelPlaceVoxel(palette, x, y, z, color_index, sides, cubePlacer);
+            }
         }
     }
     }
@@ -106,6 +228,8 @@ static SdfPrimSpecHandle createGroup(const ogt_vox_scene *scene, SdfLayerHandle
     auto prim = SdfCreatePrimInLayer(lyr, path);
     prim->SetSpecifier(SdfSpecifierDef);
     prim->SetTypeName("Xform");
+    // groups and instances form a model hierarchy, in which extentsHints are read
+    prim->SetKind(TfToken("group"));
     if (group->name) {
         prim->SetField(TfToken("displayName"), std::string(group->name));
     }
@@ -117,58 +241,1347 @@ static SdfPrimSpecHandle createGroup(const ogt_vox_scene *scene, SdfLayerHandle
     return prim;
 }
 
-static SdfPrimSpecHandle createModel(const ogt_vox_model *model, const ogt_vox_palette *palette, SdfLayerHandle lyr, SdfPath path) {
+// meshKey identifies the model's content, palette and meshing options in the process-wide mesh cache, and check
+// computes what verifies a hit on it. Deferred models are decoded here, and freed again as soon as they're meshed.
+// Safe to call from worker threads: it doesn't touch the layer.
+static SdfMeshArrays meshModel(const ogt_vox_scene *scene, const ogt_vox_model *model, bool cullCavities, uint64_t meshKey,
+                               const std::function<UsdVoxelMeshCheck()> &check) {
+    UsdVoxelMeshCache &meshCache = UsdVoxelMeshCache::get();
+    SdfMeshArrays arrays;
+    if (!meshCache.find(meshKey, check, &arrays)) {
+        const ogt_vox_model *decoded = nullptr;
+        if (model->deferred_voxel_data) {
+            decoded = ogt_vox_read_deferred_model(scene, model, k_read_scene_flags_sparse_models);
+            if (!decoded) {
+                return arrays;
+            }
+            model = decoded;
+        }
+        SdfMeshCubePlacer cubePlacer;
+        MagicavoxelRead_Model(model, &scene->palette, cullCavities, cubePlacer);
+        if (decoded) {
+            ogt_vox_destroy_model(decoded);
+        }
+        arrays = cubePlacer.takeArrays();
+        meshCache.insert(meshKey, check(), arrays);
+    }
+    return arrays;
+}
+
+// A rough upper bound on the memory needed to decode and mesh a model with this many voxels: the decoded voxels,
+// plus the mesh arrays if every voxel had all 6 faces.
+static size_t modelWorkingSetEstimate(const ogt_vox_model *model, size_t voxels) {
+    const size_t k_mesh_bytes_per_voxel = 8 * sizeof(GfVec3f) + 6 * (4 * sizeof(int) + sizeof(int) + 2 * sizeof(GfVec3f));
+    size_t decoded = std::min((size_t)model->size_x * model->size_y * model->size_z, voxels * 4);
+    return decoded + voxels * k_mesh_bytes_per_voxel;
+}
+
+// Number of bytes of voxel content: the dense grid, the packed list of a sparse model, or the raw XYZI chunk
+// of a deferred one.
+static size_t modelContentSize(const ogt_vox_model *model) {
+    if (model->deferred_voxel_data) {
+        return (size_t)model->num_deferred_voxels * 4;
+    }
+    if (model->packed_voxel_data) {
+        return (size_t)model->num_packed_voxels * 4;
+    }
+    return (size_t)model->size_x * model->size_y * model->size_z;
+}
+
+static const uint8_t *modelContent(const ogt_vox_model *model) {
+    if (model->deferred_voxel_data) {
+        return model->deferred_voxel_data;
+    }
+    return model->packed_voxel_data ? model->packed_voxel_data : model->voxel_data;
+}
+
+// 0 for dense models, 1 for sparse ones, 2 for deferred ones.
+static uint32_t modelRepresentation(const ogt_vox_model *model) {
+    return model->deferred_voxel_data ? 2 : model->packed_voxel_data ? 1 : 0;
+}
+
+static uint64_t hashModel(const ogt_vox_model *model) {
+    uint32_t dims[4] = { model->size_x, model->size_y, model->size_z, modelRepresentation(model) };
+    uint64_t hash = VoxelHash64(dims, sizeof(dims));
+    return VoxelHash64(modelContent(model), modelContentSize(model), hash);
+}
+
+// Equal models always share a representation: whether a model is sparse only depends on its dims and voxel count.
+// Deferred models are only compared by their raw voxel lists, so the same voxels listed in another order won't match.
+static bool modelsAreEqual(const ogt_vox_model *a, const ogt_vox_model *b) {
+    if (a->size_x != b->size_x || a->size_y != b->size_y || a->size_z != b->size_z) {
+        return false;
+    }
+    if (modelRepresentation(a) != modelRepresentation(b) || modelContentSize(a) != modelContentSize(b)) {
+        return false;
+    }
+    return memcmp(modelContent(a), modelContent(b), modelContentSize(a)) == 0;
+}
+
+// A signature that doesn't change when the model is rotated or mirrored: sorted dims and the color histogram.
+static uint64_t orientationInvariantSignature(const ogt_vox_model *model) {
+    uint32_t dims[3] = { model->size_x, model->size_y, model->size_z };
+    std::sort(dims, dims + 3);
+    uint64_t histogram[256] = {};
+    if (model->packed_voxel_data) {
+        for (uint32_t i = 0; i < model->num_packed_voxels; i++) {
+            histogram[model->packed_voxel_data[i * 4 + 3]]++;
+        }
+    } else {
+        size_t voxel_count = (size_t)model->size_x * model->size_y * model->size_z;
+        for (size_t i = 0; i < voxel_count; i++) {
+            histogram[model->voxel_data[i]]++;
+        }
+    }
+    uint64_t hash = VoxelHash64(dims, sizeof(dims));
+    return VoxelHash64(histogram, sizeof(histogram), hash);
+}
+
+static bool modelsMatchOriented(const ogt_vox_model *proto, const ogt_vox_model *model, const VoxelOrientation &o) {
+    uint32_t protoDims[3] = { proto->size_x, proto->size_y, proto->size_z };
+    uint32_t modelDims[3] = { model->size_x, model->size_y, model->size_z };
+    if ((proto->packed_voxel_data != NULL) != (model->packed_voxel_data != NULL)) {
+        return false;
+    }
+    if (proto->packed_voxel_data) {
+        return VoxelListsMatchOriented(protoDims, proto->packed_voxel_data, proto->num_packed_voxels,
+                                       modelDims, model->packed_voxel_data, model->num_packed_voxels, o);
+    }
+    return VoxelGridsMatchOriented(protoDims, proto->voxel_data, modelDims, model->voxel_data, o);
+}
+
+struct ModelPrototype {
+    uint32_t model_index;   // the model whose mesh is authored under /models
+    uint8_t orientation;    // index into VoxelOrientations(), placing the prototype's voxels onto this model's voxels
+    uint64_t hash;          // hashModel() of this model
+};
+
+// Maps each model index to the prototype model it can be drawn with.
+// Byte-identical models share a prototype directly. Models that only match after one of the 48 axis-aligned
+// rotations/mirrors share it too, with the orientation folded into each instance's transform.
+// Only prototype models (where prototypes[i].model_index == i) need to be meshed.
+static std::vector<ModelPrototype> dedupeModels(const ogt_vox_scene *scene) {
+    std::vector<ModelPrototype> prototypes(scene->num_models);
+    std::unordered_map<uint64_t, std::vector<uint32_t>> exactBuckets;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> orientedBuckets;
+    const VoxelOrientation *orientations = VoxelOrientations();
+
+    for (uint32_t i = 0; i < scene->num_models; i++) {
+        prototypes[i] = { i, 0, 0 };
+        const ogt_vox_model *model = scene->models[i];
+        if (!model) {
+            continue;
+        }
+        uint64_t hash = hashModel(model);
+        prototypes[i].hash = hash;
+
+        auto &exactBucket = exactBuckets[hash];
+        for (uint32_t candidate : exactBucket) {
+            // hashes can collide, so confirm with the voxel data
+            if (modelsAreEqual(scene->models[candidate], model)) {
+                prototypes[i] = { candidate, 0, hash };
+                break;
+            }
+        }
+        if (prototypes[i].model_index != i) {
+            continue;
+        }
+        if (model->deferred_voxel_data) {
+            // matching orientations needs the decoded voxels, which a streaming read doesn't keep around
+            exactBucket.push_back(i);
+            continue;
+        }
+
+        auto &orientedBucket = orientedBuckets[orientationInvariantSignature(model)];
+        for (uint32_t candidate : orientedBucket) {
+            const ogt_vox_model *proto = scene->models[candidate];
+            // the identity was already covered by the exact match
+            for (int o = 1; o < k_voxel_orientation_count; o++) {
+                if (modelsMatchOriented(proto, model, orientations[o])) {
+                    prototypes[i] = { candidate, (uint8_t)o, hash };
+                    break;
+                }
+            }
+            if (prototypes[i].model_index != i) {
+                break;
+            }
+        }
+
+        if (prototypes[i].model_index == i) {
+            exactBucket.push_back(i);
+            orientedBucket.push_back(i);
+        }
+    }
+    return prototypes;
+}
+
+// The transform that places a prototype's mesh onto the voxels of the model it stands in for.
+// Voxel centers sit on integer coordinates, so this maps each prototype cube exactly onto a model cube.
+static ogt_vox_transform prototypeToModelTransform(const ogt_vox_model *model, const VoxelOrientation &o) {
+    uint32_t modelDims[3] = { model->size_x, model->size_y, model->size_z };
+    float rows[4][3] = {};
+    for (int i = 0; i < 3; i++) {
+        rows[i][o.axis[i]] = o.flip[i] ? -1.0f : 1.0f;
+        if (o.flip[i]) {
+            rows[3][o.axis[i]] = (float)(modelDims[o.axis[i]] - 1);
+        }
+    }
+    ogt_vox_transform t = ogt_vox_transform_get_identity();
+    t.m00 = rows[0][0]; t.m01 = rows[0][1]; t.m02 = rows[0][2];
+    t.m10 = rows[1][0]; t.m11 = rows[1][1]; t.m12 = rows[1][2];
+    t.m20 = rows[2][0]; t.m21 = rows[2][1]; t.m22 = rows[2][2];
+    t.m30 = rows[3][0]; t.m31 = rows[3][1]; t.m32 = rows[3][2];
+    return t;
+}
+
+// The transform of an instance, placing its prototype's mesh.
+static ogt_vox_transform instanceTransform(const ogt_vox_scene *scene, const ogt_vox_instance *inst, const ModelPrototype &proto) {
+    if (proto.orientation == 0) {
+        return inst->transform;
+    }
+    ogt_vox_transform placement = prototypeToModelTransform(scene->models[inst->model_index], VoxelOrientations()[proto.orientation]);
+    return ogt_vox_transform_multiply(placement, inst->transform);
+}
+
+// Fewer instances of a model than this in a group keep their own prims.
+static const size_t k_point_instancer_min_instances = 2;
+
+// OpenUSD 24.11 added float orientations (orientationsf) to PointInstancer. Half precision orientations store the
+// 0.70710678 of a 90 degree rotation as 0.70703, which leaves visible cracks between abutting rotated tiles.
+static const bool k_point_instancer_float_orientations = PXR_VERSION >= 2411;
+
+// The rotation of an instance transform, and its scale: a mirrored transform is split into a scale of -1 along x,
+// then the remaining proper rotation, since orientations can't mirror.
+static GfQuatd instanceRotation(ogt_vox_transform t, GfVec3f *scale) {
+    *scale = GfVec3f(1, 1, 1);
+    if (transformToGfMatrix4d(&t).GetDeterminant3() < 0) {
+        t.m00 = -t.m00; t.m01 = -t.m01; t.m02 = -t.m02;
+        (*scale)[0] = -1;
+    }
+    return transformToGfMatrix4d(&t).ExtractRotationQuat();
+}
+
+// True if a rotation survives half precision: the quarter turns of voxel transforms have quaternion components of
+// 0, 1/2, 1/sqrt(2) and 1, and only 1/sqrt(2) isn't exact in half.
+static bool rotationIsExactInHalf(const GfQuatd &q) {
+    double components[4] = { q.GetReal(), q.GetImaginary()[0], q.GetImaginary()[1], q.GetImaginary()[2] };
+    for (double c : components) {
+        double a = fabs(c);
+        if (a > 1e-6 && fabs(a - 0.5) > 1e-6 && fabs(a - 1) > 1e-6) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// True if an instance can be drawn by a PointInstancer without losing precision.
+static bool pointInstancerCanPlace(const ogt_vox_scene *scene, const ogt_vox_instance *inst, const ModelPrototype &proto) {
+    if (k_point_instancer_float_orientations) {
+        return true;
+    }
+    GfVec3f scale;
+    return rotationIsExactInHalf(instanceRotation(instanceTransform(scene, inst, proto), &scale));
+}
+
+// A PointInstancer drawing the prototype at modelPath once per instance.
+// Instance transforms are rotations (possibly mirrored) and translations, see instanceRotation.
+static void writePointInstancer(const ogt_vox_scene *scene, SdfLayerHandle lyr, const SdfPath &path, const SdfPath &modelPath,
+                                const std::vector<ModelPrototype> &prototypes, const std::vector<uint32_t> &instances) {
+    auto prim = SdfCreatePrimInLayer(lyr, path);
+    prim->SetSpecifier(SdfSpecifierDef);
+    prim->SetTypeName("PointInstancer");
+
+    SdfPath prototypePath = path.AppendChild(TfToken("prototype"));
+    auto prototypePrim = SdfCreatePrimInLayer(lyr, prototypePath);
+    prototypePrim->GetReferenceList().Append(SdfReference("", modelPath));
+    auto rel = SdfRelationshipSpec::New(prim, "prototypes", /* custom */ false);
+    rel->GetTargetPathList().Add(prototypePath);
+
+    VtIntArray protoIndices(instances.size(), 0);
+    VtVec3fArray positions, scales;
+    VtQuatfArray orientationsf;
+    VtQuathArray orientations;
+    VtInt64Array invisibleIds;
+    bool mirrored = false;
+    for (size_t n = 0; n < instances.size(); n++) {
+        const ogt_vox_instance *inst = &scene->instances[instances[n]];
+        ogt_vox_transform t = instanceTransform(scene, inst, prototypes[inst->model_index]);
+        GfVec3f scale;
+        GfQuatd rotation = instanceRotation(t, &scale);
+        mirrored = mirrored || scale[0] < 0;
+        positions.push_back(GfVec3f(t.m30, t.m31, t.m32));
+        if (k_point_instancer_float_orientations) {
+            orientationsf.push_back(GfQuatf(rotation));
+        } else {
+            orientations.push_back(GfQuath(rotation));
+        }
+        scales.push_back(scale);
+        if (inst->hidden) {
+            invisibleIds.push_back((int64_t)n);
+        }
+    }
+
+    auto attr = SdfAttributeSpec::New(prim, "protoIndices", SdfValueTypeNames->IntArray);
+    attr->SetDefaultValue(VtValue(protoIndices));
+    attr = SdfAttributeSpec::New(prim, "positions", SdfValueTypeNames->Point3fArray);
+    attr->SetDefaultValue(VtValue(positions));
+    if (k_point_instancer_float_orientations) {
+        attr = SdfAttributeSpec::New(prim, "orientationsf", SdfValueTypeNames->QuatfArray);
+        attr->SetDefaultValue(VtValue(orientationsf));
+    } else {
+        attr = SdfAttributeSpec::New(prim, "orientations", SdfValueTypeNames->QuathArray);
+        attr->SetDefaultValue(VtValue(orientations));
+    }
+    if (mirrored) {
+        attr = SdfAttributeSpec::New(prim, "scales", SdfValueTypeNames->Float3Array);
+        attr->SetDefaultValue(VtValue(scales));
+    }
+    if (!invisibleIds.empty()) {
+        attr = SdfAttributeSpec::New(prim, "invisibleIds", SdfValueTypeNames->Int64Array);
+        attr->SetDefaultValue(VtValue(invisibleIds));
+    }
+}
+
+// bvh=1: groups with at least this many instance prims get a BVH of Xforms between them and their instances,
+// with no more than k_bvh_leaf_instances instances under each leaf.
+static const size_t k_bvh_min_instances = 16;
+static const size_t k_bvh_leaf_instances = 8;
+
+// An instance's bounds in its group's space.
+struct InstanceBounds {
+    uint32_t instance;
+    GfVec3f lo, hi;
+};
+
+// The bounds of the box from extent[0] to extent[1] under a transform.
+static void transformedBounds(const float extent[2][3], const ogt_vox_transform &t, GfVec3f *lo, GfVec3f *hi) {
+    *lo = GfVec3f(FLT_MAX, FLT_MAX, FLT_MAX);
+    *hi = GfVec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (int corner = 0; corner < 8; corner++) {
+        float x = extent[corner & 1][0], y = extent[(corner >> 1) & 1][1], z = extent[(corner >> 2) & 1][2];
+        // basis vectors are rows
+        float p[3] = {
+            x * t.m00 + y * t.m10 + z * t.m20 + t.m30,
+            x * t.m01 + y * t.m11 + z * t.m21 + t.m31,
+            x * t.m02 + y * t.m12 + z * t.m22 + t.m32,
+        };
+        for (int axis = 0; axis < 3; axis++) {
+            (*lo)[axis] = std::min((*lo)[axis], p[axis]);
+            (*hi)[axis] = std::max((*hi)[axis], p[axis]);
+        }
+    }
+}
+
+static InstanceBounds instanceBounds(const ogt_vox_scene *scene, uint32_t instanceIndex) {
+    const ogt_vox_instance *inst = &scene->instances[instanceIndex];
+    const ogt_vox_model *model = scene->models[inst->model_index];
+    const ogt_vox_transform &t = inst->transform;
+    InstanceBounds bounds = {};
+    bounds.instance = instanceIndex;
+    if (!model) {
+        bounds.lo = bounds.hi = GfVec3f(t.m30, t.m31, t.m32);
+        return bounds;
+    }
+    // voxel centers sit on integer coordinates
+    const float extent[2][3] = {
+        { -0.5f, -0.5f, -0.5f },
+        { (float)model->size_x - 0.5f, (float)model->size_y - 0.5f, (float)model->size_z - 0.5f },
+    };
+    transformedBounds(extent, t, &bounds.lo, &bounds.hi);
+    return bounds;
+}
+
+// Splits instances in two at the median of their centers along the longest axis of the centers' bounds, and
+// writes an Xform for each half (bvh0 and bvh1) under path with the half's extentsHint, recursively.
+// Records the prim each instance ends up under in instanceParents.
+static void writeBvhNodes(SdfLayerHandle lyr, const SdfPath &path, std::vector<InstanceBounds>::iterator begin,
+                          std::vector<InstanceBounds>::iterator end, std::map<uint32_t, SdfPath> &instanceParents) {
+    size_t count = end - begin;
+    if (count <= k_bvh_leaf_instances) {
+        for (auto it = begin; it != end; ++it) {
+            instanceParents[it->instance] = path;
+        }
+        return;
+    }
+
+    float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (auto it = begin; it != end; ++it) {
+        for (int axis = 0; axis < 3; axis++) {
+            float center = 0.5f * (it->lo[axis] + it->hi[axis]);
+            lo[axis] = std::min(lo[axis], center);
+            hi[axis] = std::max(hi[axis], center);
+        }
+    }
+    int axis = 0;
+    for (int a = 1; a < 3; a++) {
+        if (hi[a] - lo[a] > hi[axis] - lo[axis]) {
+            axis = a;
+        }
+    }
+    auto middle = begin + count / 2;
+    // ties are broken by instance index, so the tree doesn't depend on the sort's whims
+    std::nth_element(begin, middle, end, [axis](const InstanceBounds &a, const InstanceBounds &b) {
+        float ca = a.lo[axis] + a.hi[axis], cb = b.lo[axis] + b.hi[axis];
+        return ca < cb || (ca == cb && a.instance < b.instance);
+    });
+
+    std::vector<InstanceBounds>::iterator halves[3] = { begin, middle, end };
+    for (int half = 0; half < 2; half++) {
+        GfVec3f nodeLo(FLT_MAX, FLT_MAX, FLT_MAX), nodeHi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (auto it = halves[half]; it != halves[half + 1]; ++it) {
+            for (int a = 0; a < 3; a++) {
+                nodeLo[a] = std::min(nodeLo[a], it->lo[a]);
+                nodeHi[a] = std::max(nodeHi[a], it->hi[a]);
+            }
+        }
+        SdfPath nodePath = path.AppendChild(TfToken(half == 0 ? "bvh0" : "bvh1"));
+        auto prim = SdfCreatePrimInLayer(lyr, nodePath);
+        prim->SetSpecifier(SdfSpecifierDef);
+        prim->SetTypeName("Xform");
+        // a group model, so that bounds queries read its extentsHint rather than visiting its instances
+        prim->SetKind(TfToken("group"));
+        auto attr = SdfAttributeSpec::New(prim, "extentsHint", SdfValueTypeNames->Float3Array);
+        attr->SetDefaultValue(VtValue(VtVec3fArray({ nodeLo, nodeHi })));
+        writeBvhNodes(lyr, nodePath, halves[half], halves[half + 1], instanceParents);
+    }
+}
+
+struct MagicavoxelReadOptions {
+    // From the layer's file format arguments.
+    UsdVoxelReadOptions conversion;
+    // The layer being read (which specs may be authored into a separate layer for). Model payloads point back
+    // into its file, and on a reload its current content provides the meshes of models that haven't changed.
+    SdfLayerHandle source;
+    // If not 0, bounds the memory used by models being decoded and meshed at any one time.
+    size_t memoryBudget = 0;
+    // Fetches the voxels of deferred models, if they aren't in the buffer the scene was read from.
+    const UsdVoxelVoxAssetReader *reader = nullptr;
+    // If false, only the scene hierarchy is authored, and the model prims are left empty.
+    bool meshModels = true;
+};
+
+// The same models are often opened through other files or file format arguments; their meshes are shared
+// between scenes with the same palette.
+static uint64_t scenePaletteHash(const ogt_vox_scene *scene) {
+    uint64_t hash = VoxelHash64(&scene->palette, sizeof(scene->palette));
+    // deferred models' colors are remapped when they're decoded, so their raw content doesn't include it
+    return VoxelHash64(scene->color_index_remap, sizeof(scene->color_index_remap), hash);
+}
+
+// Each meshed model prim records the hash its mesh was keyed by, so a reload can tell which models changed.
+static const char *k_mesh_hash_key = "voxelMeshHash";
+
+static uint64_t previousMeshHash(SdfLayerHandle source, const SdfPath &path) {
+    auto prim = source ? source->GetPrimAtPath(path) : SdfPrimSpecHandle();
+    if (!prim) {
+        return 0;
+    }
+    VtDictionary customData = prim->GetCustomData();
+    auto it = customData.find(k_mesh_hash_key);
+    if (it == customData.end() || !it->second.IsHolding<uint64_t>()) {
+        return 0;
+    }
+    return it->second.UncheckedGet<uint64_t>();
+}
+
+// The number of solid voxels in a decoded model.
+static size_t modelSolidVoxelCount(const ogt_vox_model *model) {
+    if (model->deferred_voxel_data) {
+        return model->num_deferred_voxels;
+    }
+    if (model->packed_voxel_data) {
+        return model->num_packed_voxels;
+    }
+    size_t count = 0;
+    size_t numVoxels = (size_t)model->size_x * model->size_y * model->size_z;
+    for (size_t i = 0; i < numVoxels; i++) {
+        count += model->voxel_data[i] != 0;
+    }
+    return count;
+}
+
+// Everything a model's mesh hash is made from, hashed again independently of it.
+static UsdVoxelMeshCheck modelMeshCheck(const ogt_vox_scene *scene, const ogt_vox_model *model, bool cullCavities, size_t voxelCount) {
+    UsdVoxelMeshCheck check;
+    check.dims[0] = model->size_x;
+    check.dims[1] = model->size_y;
+    check.dims[2] = model->size_z;
+    check.voxels = voxelCount;
+    check.hash = VoxelHash64Check(modelContent(model), modelContentSize(model));
+    check.hash = VoxelHashCombine(check.hash, VoxelHash64Check(&scene->palette, sizeof(scene->palette)));
+    check.hash = VoxelHashCombine(check.hash, VoxelHash64Check(scene->color_index_remap, sizeof(scene->color_index_remap)));
+    check.hash = VoxelHashCombine(check.hash, modelRepresentation(model) | (cullCavities ? 4 : 0));
+    return check;
+}
+
+// The connected components of a model's solid voxels, for splitComponents=1. Deferred models are decoded here
+// (again, if their mesh came from the cache), and freed once they're labelled.
+static std::unique_ptr<VoxelSolidComponents> modelSolidComponents(const ogt_vox_scene *scene, const ogt_vox_model *model) {
+    const ogt_vox_model *decoded = nullptr;
+    if (model->deferred_voxel_data) {
+        decoded = ogt_vox_read_deferred_model(scene, model, k_read_scene_flags_sparse_models);
+        if (!decoded) {
+            return nullptr;
+        }
+        model = decoded;
+    }
+    std::unique_ptr<VoxelSolidComponents> solid(new VoxelSolidComponents(model->size_x, model->size_y, model->size_z));
+    if (model->packed_voxel_data) {
+        for (uint32_t i = 0; i < model->num_packed_voxels; i++) {
+            const uint8_t *v = &model->packed_voxel_data[i * 4];
+            solid->addSolid(v[0], v[1], v[2]);
+        }
+    } else {
+        size_t voxel_index = 0;
+        for (uint32_t z = 0; z < model->size_z; z++) {
+        for (uint32_t y = 0; y < model->size_y; y++) {
+        for (uint32_t x = 0; x < model->size_x; x++, voxel_index++) {
+            if (model->voxel_data[voxel_index] != 0) {
+                solid->addSolid(x, y, z);
+            }
+        }
+        }
+        }
+    }
+    if (decoded) {
+        ogt_vox_destroy_model(decoded);
+    }
+    solid->label();
+    return solid;
+}
+
+// A model's mesh, or only its hash if the source layer already holds that mesh.
+struct ModelMesh {
+    uint64_t hash = 0;      // 0 if the model's voxels couldn't be read
+    bool unchanged = false;
+    VoxelModelRepresentation mesh;
+};
+
+// Meshes a model, unless its mesh hash matches previousHash. contentHash is hashModel() of the model,
+// or 0 to compute it here. Models read through a reader are hashed by the fetched voxels rather than
+// by the (empty) placeholder model.
+static ModelMesh meshSceneModel(const ogt_vox_scene *scene, uint32_t modelIndex, const MagicavoxelReadOptions &options,
+                                uint64_t contentHash, uint64_t paletteHash, uint64_t previousHash) {
+    ModelMesh result;
+    const ogt_vox_model *model = scene->models[modelIndex];
+    std::vector<uint8_t> voxels;
+    ogt_vox_model fetched;
+    if (options.reader) {
+        if (!options.reader->readModelVoxels(modelIndex, &voxels) || voxels.empty()) {
+            result.mesh = VoxelModelRepresentation(SdfMeshArrays(), 0, options.conversion);
+            return result;
+        }
+        fetched = *model;
+        fetched.deferred_voxel_data = voxels.data();
+        fetched.num_deferred_voxels = (uint32_t)(voxels.size() / 4);
+        model = &fetched;
+        contentHash = hashModel(model);
+    } else if (contentHash == 0) {
+        contentHash = hashModel(model);
+    }
+    result.hash = VoxelHashCombine(contentHash, paletteHash);
+    if (options.conversion.cullCavities) {
+        result.hash = VoxelHashCombine(result.hash, VoxelHash64("cullCavities", 12));
+    }
+    if (result.hash == previousHash) {
+        result.unchanged = true;
+        return result;
+    }
+    const bool cullCavities = options.conversion.cullCavities;
+    const size_t voxelCount = modelSolidVoxelCount(model);
+    SdfMeshArrays cubes = meshModel(scene, model, cullCavities, result.hash,
+                                    [&]() { return modelMeshCheck(scene, model, cullCavities, voxelCount); });
+    std::unique_ptr<VoxelSolidComponents> solid;
+    const UsdVoxelRepresentation representation = options.conversion.representation;
+    if (options.conversion.splitComponents && representation != k_representation_point_instancer &&
+        representation != k_representation_points) {
+        solid = modelSolidComponents(scene, model);
+    }
+    result.mesh = VoxelModelRepresentation(cubes, voxelCount, options.conversion, solid.get());
+    return result;
+}
+
+// Unchanged models are copied over from the source layer, so the arrays are shared rather than rebuilt, and
+// Sdf finds nothing to notify about when the new data replaces the old.
+static void writeModelMesh(SdfLayerHandle lyr, const SdfPath &path, const ModelMesh &modelMesh, const MagicavoxelReadOptions &options) {
+    if (modelMesh.unchanged) {
+        SdfCopySpec(options.source, path, lyr, path);
+        return;
+    }
+    auto prim = modelMesh.mesh.writePrim(lyr, path);
+    if (modelMesh.hash != 0) {
+        prim->SetCustomData(k_mesh_hash_key, VtValue(modelMesh.hash));
+    }
+}
+
+// The identifier of this layer, reading only the given model: "./<file>:SDF_FORMAT_ARGS:model=<index>".
+// It's relative, so it stays valid when the file and the layers referring to it move together. It does name the
+// file, so cached payloads=1 conversions are keyed by the file's name as well (see UsdVoxelVoxFileFormat::Read).
+static std::string modelPayloadAssetPath(SdfLayerHandle source, uint32_t modelIndex) {
+    std::string layerPath;
+    SdfLayer::FileFormatArguments args;
+    SdfLayer::SplitIdentifier(source->GetIdentifier(), &layerPath, &args);
+    // A model's mesh doesn't depend on the arguments that only shape the scene around it: dropping them keeps
+    // one payload layer (and cache entry) per model.
+    for (const char *sceneOnly : { "payloads", "instancing", "bvh", "merge", "cullSeams",
+                                   "layers", "excludeLayers", "groups", "excludeGroups", "instances", "excludeInstances",
+                                   "hiddenLayers", "crop", "cropUnits" }) {
+        args.erase(sceneOnly);
+    }
+    args["model"] = std::to_string(modelIndex);
+    return SdfLayer::CreateIdentifier("./" + TfGetBaseName(layerPath), args);
+}
+
+// The box of a model's grid, as an extent.
+static VtVec3fArray modelBoxExtent(const ogt_vox_model *model) {
+    // voxel centers sit on integer coordinates
+    return VtVec3fArray({
+        GfVec3f(-0.5f, -0.5f, -0.5f),
+        GfVec3f((float)model->size_x - 0.5f, (float)model->size_y - 0.5f, (float)model->size_z - 0.5f),
+    });
+}
+
+// A prim whose geometry is loaded from a payload. It has the type of the prim the payload brings in: a Mesh,
+// PointInstancer or Points (with the model's bounds as its extent), or the Xform holding the chunks or components,
+// which isn't boundable; the instance prims referencing it carry the bounds as an extentsHint instead. With
+// representation=auto the type is left to the payload.
+static void writeModelPayloadPrim(const ogt_vox_model *model, SdfLayerHandle lyr, const SdfPath &path, const std::string &assetPath,
+                                  const UsdVoxelReadOptions &options) {
+    std::string typeName = VoxelRepresentationPrimType(options);
+    bool split = typeName.empty() || typeName == "Xform";
+    auto prim = SdfCreatePrimInLayer(lyr, path);
+    prim->SetSpecifier(SdfSpecifierDef);
+    prim->SetTypeName(typeName);
+    if (!split) {
+        auto attr = SdfAttributeSpec::New(prim, "extent", SdfValueTypeNames->Float3Array);
+        attr->SetDefaultValue(VtValue(modelBoxExtent(model)));
+    }
+    prim->GetPayloadList().Append(SdfPayload(assetPath));
+}
+
+// Fewer mergeable instances than this under a group keep their own prims.
+static const size_t k_merge_min_instances = 2;
+
+// True if neither the instance nor any group above it is animated, so its first frame holds throughout.
+static bool instanceIsStatic(const ogt_vox_scene *scene, const ogt_vox_instance *inst) {
+    if (inst->transform_anim.num_keyframes > 1 || inst->model_anim.num_keyframes > 1) {
+        return false;
+    }
+    for (uint32_t g = inst->group_index; g != k_invalid_group_index; g = scene->groups[g].parent_group_index) {
+        if (scene->groups[g].transform_anim.num_keyframes > 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The rows of a transform that maps voxel centers onto voxel centers: a rotation (possibly mirrored) with
+// entries of -1, 0 and 1, and a whole translation. False for any other transform.
+static bool voxelAlignedTransform(const ogt_vox_transform &t, int32_t rows[4][3]) {
+    const float m[4][3] = {
+        { t.m00, t.m01, t.m02 },
+        { t.m10, t.m11, t.m12 },
+        { t.m20, t.m21, t.m22 },
+        { t.m30, t.m31, t.m32 },
+    };
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 3; c++) {
+            float rounded = roundf(m[r][c]);
+            if (fabsf(m[r][c] - rounded) > 1e-4f || (r < 3 && fabsf(rounded) > 1)) {
+                return false;
+            }
+            rows[r][c] = (int32_t)rounded;
+        }
+    }
+    return true;
+}
+
+// World voxel coordinates are packed 21 bits each, like chunk coordinates.
+static const int32_t k_world_key_bias = 1 << 20;
+
+static inline uint64_t packedWorldVoxelKey(int32_t x, int32_t y, int32_t z) {
+    return ((uint64_t)((uint32_t)(x + k_world_key_bias) & 0x1fffff) << 42)
+         | ((uint64_t)((uint32_t)(y + k_world_key_bias) & 0x1fffff) << 21)
+         | (uint64_t)((uint32_t)(z + k_world_key_bias) & 0x1fffff);
+}
+
+static inline void unpackWorldVoxelKey(uint64_t key, int32_t *x, int32_t *y, int32_t *z) {
+    *x = (int32_t)((key >> 42) & 0x1fffff) - k_world_key_bias;
+    *y = (int32_t)((key >> 21) & 0x1fffff) - k_world_key_bias;
+    *z = (int32_t)(key & 0x1fffff) - k_world_key_bias;
+}
+
+// The world key of a model's voxel, placed by the rows of a voxel-aligned transform.
+static inline uint64_t worldVoxelKey(const int32_t m[4][3], int32_t x, int32_t y, int32_t z) {
+    // basis vectors are rows
+    return packedWorldVoxelKey(x * m[0][0] + y * m[1][0] + z * m[2][0] + m[3][0],
+                               x * m[0][1] + y * m[1][1] + z * m[2][1] + m[3][1],
+                               x * m[0][2] + y * m[1][2] + z * m[2][2] + m[3][2]);
+}
+
+// The voxel-aligned world transform of a static instance, sampled at the first frame.
+// False if the instance is animated or isn't placed on the voxel grid.
+static bool instanceWorldTransform(const ogt_vox_scene *scene, const ogt_vox_instance *inst, int32_t rows[4][3]) {
+    return instanceIsStatic(scene, inst) && voxelAlignedTransform(ogt_vox_sample_instance_transform_global(inst, 0, scene), rows);
+}
+
+// Calls visit(x, y, z, color_index) for each solid voxel of a model. Deferred models are decoded (or fetched
+// through the reader) here, and freed again afterwards. Safe to call from worker threads.
+template <class F>
+static bool forEachModelVoxel(const ogt_vox_scene *scene, uint32_t modelIndex, const MagicavoxelReadOptions &options, F visit) {
+    const ogt_vox_model *model = scene->models[modelIndex];
+    std::vector<uint8_t> voxels;
+    ogt_vox_model fetched;
+    if (options.reader) {
+        if (!options.reader->readModelVoxels(modelIndex, &voxels)) {
+            return false;
+        }
+        if (voxels.empty()) {
+            return true;
+        }
+        fetched = *model;
+        fetched.deferred_voxel_data = voxels.data();
+        fetched.num_deferred_voxels = (uint32_t)(voxels.size() / 4);
+        model = &fetched;
+    }
+    const ogt_vox_model *decoded = nullptr;
+    if (model->deferred_voxel_data) {
+        decoded = ogt_vox_read_deferred_model(scene, model, k_read_scene_flags_sparse_models);
+        if (!decoded) {
+            return false;
+        }
+        model = decoded;
+    }
+
+    if (model->packed_voxel_data) {
+        for (uint32_t i = 0; i < model->num_packed_voxels; i++) {
+            const uint8_t *v = &model->packed_voxel_data[i * 4];
+            visit(v[0], v[1], v[2], v[3]);
+        }
+    } else {
+        const uint8_t *grid = model->voxel_data;
+        size_t voxel_index = 0;
+        for (uint32_t z = 0; z < model->size_z; z++) {
+        for (uint32_t y = 0; y < model->size_y; y++) {
+        for (uint32_t x = 0; x < model->size_x; x++, voxel_index++) {
+            if (grid[voxel_index] != 0) {
+                visit(x, y, z, grid[voxel_index]);
+            }
+        }
+        }
+        }
+    }
+    if (decoded) {
+        ogt_vox_destroy_model(decoded);
+    }
+    return true;
+}
+
+// Meshes a set of world-space voxels, culling faces against neighbours from any model, against the voxels
+// of the rest of the scene if world isn't null, and against sealed cavities if exterior isn't null.
+template <class T>
+static void MagicavoxelRead_WorldVoxels(const VoxelColorMap &voxels, const VoxelColorMap *world, const VoxelExterior *exterior,
+                                        const ogt_vox_palette *palette, T &cubePlacer) {
+    auto solid = [&](int32_t x, int32_t y, int32_t z) {
+        uint64_t key = packedWorldVoxelKey(x, y, z);
+        return voxels.find(key) != 0 || (world && world->find(key) != 0) || !cellIsExterior(exterior, x, y, z);
+    };
+    voxels.forEach([&](uint64_t key, uint8_t color_index) {
+        int32_t x, y, z;
+        unpackWorldVoxelKey(key, &x, &y, &z);
+        uint8_t sides = 0;
+        if (!solid(x-1, y, z)) sides |= k_cube_side_left;
+        if (!solid(x+1, y, z)) sides |= k_cube_side_right;
+        if (!solid(x, y, z-1)) sides |= k_cube_side_back;
+        if (!solid(x, y, z+1)) sides |= k_cube_side_front;
+        if (!solid(x, y+1, z)) sides |= k_cube_side_top;
+        if (!solid(x, y-1, z)) sides |= k_cube_side_bottom;
+        if (sides != 0) {
+            ogt_vox_rgba color = palette->color[color_index];
+            cubePlacer.place(x, y, z, (float)color.r / 255.0f, (float)color.g / 255.0f, (float)color.b / 255.0f, sides);
+        }
+    });
+}
+
+// The static, visible instances directly under one group, to be meshed together.
+struct MergedInstances {
+    uint32_t group_index;
+    std::vector<uint32_t> instances;
+    size_t voxelCount = 0;      // an upper bound, for sizing the voxel map
+};
+
+// Groups the instances that merge=1 merges, and flags them in merged. An instance is merged if it's static and
+// visible, and its transform keeps voxels on the voxel grid, since the merged voxels are meshed on that grid.
+static std::vector<MergedInstances> planMergedInstances(const ogt_vox_scene *scene, const std::function<size_t(uint32_t)> &modelVoxelCount,
+                                                        const std::vector<bool> &included, std::vector<bool> &merged) {
+    std::map<uint32_t, MergedInstances> groups;
+    for (uint32_t i = 0; i < scene->num_instances; i++) {
+        const ogt_vox_instance *inst = &scene->instances[i];
+        int32_t rows[4][3];
+        if (!included[i] || inst->hidden || !scene->models[inst->model_index] || !instanceWorldTransform(scene, inst, rows)) {
+            continue;
+        }
+        MergedInstances &group = groups[inst->group_index];
+        group.group_index = inst->group_index;
+        group.instances.push_back(i);
+        group.voxelCount += modelVoxelCount(inst->model_index);
+    }
+
+    std::vector<MergedInstances> result;
+    for (auto &entry : groups) {
+        if (entry.second.instances.size() < k_merge_min_instances) {
+            continue;
+        }
+        for (uint32_t i : entry.second.instances) {
+            merged[i] = true;
+        }
+        result.push_back(std::move(entry.second));
+    }
+    return result;
+}
+
+// Brings a mesh of world space voxels into the space of a group's prim, by the inverse of the group's transform at
+// the first frame (merged instances are static, so their groups are too). Merged instances are on the voxel grid,
+// so for the usual voxel-aligned groups the points stay exactly on it.
+static void meshToGroupSpace(const ogt_vox_scene *scene, uint32_t group_index, SdfMeshArrays *arrays) {
+    if (group_index == k_invalid_group_index) {
+        return;
+    }
+    const ogt_vox_transform global = ogt_vox_sample_group_transform_global(&scene->groups[group_index], 0, scene);
+    const GfMatrix4d inverse = transformToGfMatrix4d(&global).GetInverse();
+    // basis vectors are rows
+    for (size_t i = 0; i < arrays->points.size(); i++) {
+        const GfVec3f p = arrays->points[i];
+        GfVec3f local;
+        for (int c = 0; c < 3; c++) {
+            local[c] = (float)(p[0] * inverse[0][c] + p[1] * inverse[1][c] + p[2] * inverse[2][c] + inverse[3][c]);
+        }
+        arrays->points[i] = local;
+    }
+    for (size_t i = 0; i < arrays->normals.size(); i++) {
+        const GfVec3f n = arrays->normals[i];
+        GfVec3f local;
+        for (int c = 0; c < 3; c++) {
+            local[c] = (float)(n[0] * inverse[0][c] + n[1] * inverse[1][c] + n[2] * inverse[2][c]);
+        }
+        arrays->normals[i] = local;
+    }
+}
+
+// The largest grid cullCavities=1 flood fills for a merged mesh.
+static const uint64_t k_merged_cavity_max_cells = 64 * 1024 * 1024;
+
+// Places every voxel of the instances at its world position, sampled at the first frame, and meshes them as one.
+// Where instances overlap, the later one's voxels win.
+static SdfMeshArrays meshMergedInstances(const ogt_vox_scene *scene, const MergedInstances &group, const VoxelColorMap *world,
+                                         const MagicavoxelReadOptions &options) {
+    VoxelColorMap voxels(group.voxelCount);
+    for (uint32_t i : group.instances) {
+        const ogt_vox_instance *inst = &scene->instances[i];
+        int32_t m[4][3];
+        instanceWorldTransform(scene, inst, m);
+        forEachModelVoxel(scene, inst->model_index, options, [&](uint32_t x, uint32_t y, uint32_t z, uint8_t color_index) {
+            voxels.insert(worldVoxelKey(m, x, y, z), color_index);
+        });
+    }
+    std::unique_ptr<VoxelExterior> exterior;
+    if (options.conversion.cullCavities && voxels.size() != 0) {
+        int32_t lo[3] = { INT32_MAX, INT32_MAX, INT32_MAX }, hi[3] = { INT32_MIN, INT32_MIN, INT32_MIN };
+        voxels.forEach([&](uint64_t key, uint8_t) {
+            int32_t v[3];
+            unpackWorldVoxelKey(key, &v[0], &v[1], &v[2]);
+            for (int axis = 0; axis < 3; axis++) {
+                lo[axis] = std::min(lo[axis], v[axis]);
+                hi[axis] = std::max(hi[axis], v[axis]);
+            }
+        });
+        uint32_t size[3] = { (uint32_t)(hi[0] - lo[0] + 1), (uint32_t)(hi[1] - lo[1] + 1), (uint32_t)(hi[2] - lo[2] + 1) };
+        // sprawling groups would need a huge grid for the fill; they keep their cavities
+        if ((uint64_t)(size[0] + 2) * (size[1] + 2) * (size[2] + 2) <= k_merged_cavity_max_cells) {
+            exterior.reset(new VoxelExterior(lo, size, [&](auto visit) {
+                voxels.forEach([&](uint64_t key, uint8_t) {
+                    int32_t x, y, z;
+                    unpackWorldVoxelKey(key, &x, &y, &z);
+                    visit(x, y, z);
+                });
+            }));
+        }
+    }
+    SdfMeshCubePlacer cubePlacer;
+    MagicavoxelRead_WorldVoxels(voxels, world, exterior.get(), &scene->palette, cubePlacer);
+    SdfMeshArrays arrays = cubePlacer.takeArrays();
+    meshToGroupSpace(scene, group.group_index, &arrays);
+    return arrays;
+}
+
+// True if neither the instance nor any group above it is hidden.
+static bool instanceIsVisible(const ogt_vox_scene *scene, const ogt_vox_instance *inst) {
+    if (inst->hidden) {
+        return false;
+    }
+    for (uint32_t g = inst->group_index; g != k_invalid_group_index; g = scene->groups[g].parent_group_index) {
+        if (scene->groups[g].hidden) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The voxels of every static, visible, voxel-aligned instance, in world space. Each model is decoded once,
+// however many instances it has. Voxels of hidden or animated instances never hide anything.
+static VoxelColorMap worldVoxelsOfInstances(const ogt_vox_scene *scene, const std::vector<uint32_t> &instances,
+                                            const std::function<size_t(uint32_t)> &modelVoxelCount, const MagicavoxelReadOptions &options) {
+    std::map<uint32_t, std::vector<uint32_t>> modelInstances;
+    size_t voxelCount = 0;
+    for (uint32_t i : instances) {
+        uint32_t model_index = scene->instances[i].model_index;
+        modelInstances[model_index].push_back(i);
+        voxelCount += modelVoxelCount(model_index);
+    }
+    VoxelColorMap world(voxelCount);
+    for (auto &entry : modelInstances) {
+        struct Rows {
+            int32_t m[4][3];
+        };
+        std::vector<Rows> transforms(entry.second.size());
+        for (size_t n = 0; n < entry.second.size(); n++) {
+            instanceWorldTransform(scene, &scene->instances[entry.second[n]], transforms[n].m);
+        }
+        forEachModelVoxel(scene, entry.first, options, [&](uint32_t x, uint32_t y, uint32_t z, uint8_t color_index) {
+            for (const Rows &rows : transforms) {
+                world.insert(worldVoxelKey(rows.m, x, y, z), color_index);
+            }
+        });
+    }
+    return world;
+}
+
+// Offsets to a voxel's neighbour across each face, with the face's side bit.
+static const struct {
+    int32_t dx, dy, dz;
+    uint8_t side;
+} k_cube_neighbours[6] = {
+    { -1,  0,  0, k_cube_side_left },
+    {  1,  0,  0, k_cube_side_right },
+    {  0,  0, -1, k_cube_side_back },
+    {  0,  0,  1, k_cube_side_front },
+    {  0,  1,  0, k_cube_side_top },
+    {  0, -1,  0, k_cube_side_bottom },
+};
+
+// An instance's model meshed with its faces culled against the world voxels, in model space, if voxels of
+// other instances hide any face the model's own mesh has. Returns false (and leaves arrays alone) if none do,
+// in which case the instance can keep sharing the model's mesh. Safe to call from worker threads.
+static bool meshSeamCulledInstance(const ogt_vox_scene *scene, uint32_t instanceIndex, const VoxelColorMap &world,
+                                   const MagicavoxelReadOptions &options, SdfMeshArrays *arrays) {
+    const ogt_vox_instance *inst = &scene->instances[instanceIndex];
+    const ogt_vox_model *model = scene->models[inst->model_index];
+    int32_t m[4][3];
+    instanceWorldTransform(scene, inst, m);
+
+    std::vector<uint8_t> voxels;
+    forEachModelVoxel(scene, inst->model_index, options, [&](uint32_t x, uint32_t y, uint32_t z, uint8_t color_index) {
+        uint8_t v[4] = { (uint8_t)x, (uint8_t)y, (uint8_t)z, color_index };
+        voxels.insert(voxels.end(), v, v + 4);
+    });
+    size_t count = voxels.size() / 4;
+    VoxelKeySet solid(count);
+    for (size_t i = 0; i < count; i++) {
+        solid.insert(packedVoxelKey(voxels[i * 4], voxels[i * 4 + 1], voxels[i * 4 + 2]));
+    }
+
+    std::unique_ptr<VoxelExterior> exterior;
+    if (options.conversion.cullCavities) {
+        const int32_t lo[3] = { 0, 0, 0 };
+        const uint32_t size[3] = { model->size_x, model->size_y, model->size_z };
+        exterior.reset(new VoxelExterior(lo, size, [&](auto visit) {
+            for (size_t i = 0; i < count; i++) {
+                visit(voxels[i * 4], voxels[i * 4 + 1], voxels[i * 4 + 2]);
+            }
+        }));
+    }
+
+    std::vector<uint8_t> sides(count, 0);
+    bool seam = false;
+    for (size_t i = 0; i < count; i++) {
+        int32_t x = voxels[i * 4], y = voxels[i * 4 + 1], z = voxels[i * 4 + 2];
+        for (const auto &n : k_cube_neighbours) {
+            int32_t nx = x + n.dx, ny = y + n.dy, nz = z + n.dz;
+            bool inModel = nx >= 0 && ny >= 0 && nz >= 0 &&
+                           nx < (int32_t)model->size_x && ny < (int32_t)model->size_y && nz < (int32_t)model->size_z &&
+                           solid.contains(packedVoxelKey(nx, ny, nz));
+            if (!cellIsExterior(exterior.get(), nx, ny, nz)) {
+                continue;
+            }
+            // the instance's own voxels are in the world too
+            if (world.find(worldVoxelKey(m, nx, ny, nz))) {
+                seam |= !inModel;
+            } else {
+                sides[i] |= n.side;
+            }
+        }
+    }
+    if (!seam) {
+        return false;
+    }
+
     SdfMeshCubePlacer cubePlacer;
-    MagicavoxelRead_Model(model, palette, cubePlacer);
-    return cubePlacer.writePrim(lyr, path);
+    for (size_t i = 0; i < count; i++) {
+        if (sides[i] != 0) {
+            const uint8_t *v = &voxels[i * 4];
+            MagicavoxelPlaceVoxel(&scene->palette, v[0], v[1], v[2], v[3], sides[i], cubePlacer);
+        }
+    }
+    *arrays = cubePlacer.takeArrays();
+    return true;
+}
+
+static bool nameIsListed(const char *name, const std::vector<std::string> &names) {
+    return name && std::find(names.begin(), names.end(), name) != names.end();
 }
 
-static bool MagicavoxelRead_impl(const ogt_vox_scene *scene, SdfLayerHandle lyr) {
+// True if any of an instance's voxel centers may be inside the crop box, placed as at the first frame.
+// The layer's coordinates are the scene's voxel grid, so the box is in the same units either way.
+static bool instanceTouchesCrop(const ogt_vox_scene *scene, const ogt_vox_instance *inst, const UsdVoxelReadOptions &options) {
+    const ogt_vox_model *model = scene->models[inst->model_index];
+    if (!model) {
+        return false;
+    }
+    const float centers[2][3] = {
+        { 0, 0, 0 },
+        { (float)model->size_x - 1, (float)model->size_y - 1, (float)model->size_z - 1 },
+    };
+    GfVec3f lo, hi;
+    transformedBounds(centers, ogt_vox_sample_instance_transform_global(inst, 0, scene), &lo, &hi);
+    for (int axis = 0; axis < 3; axis++) {
+        if (hi[axis] < options.cropMin[axis] || lo[axis] > options.cropMax[axis]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether the layer, group and instance name filters and the crop box let an instance through.
+static bool instanceIsIncluded(const ogt_vox_scene *scene, const ogt_vox_instance *inst, const UsdVoxelReadOptions &options) {
+    if (options.crop && !instanceTouchesCrop(scene, inst, options)) {
+        return false;
+    }
+    const ogt_vox_layer *layer = inst->layer_index < scene->num_layers ? &scene->layers[inst->layer_index] : nullptr;
+    const char *layerName = layer ? layer->name : nullptr;
+    if (layer && layer->hidden && !options.hiddenLayers) {
+        return false;
+    }
+    if ((!options.layers.empty() && !nameIsListed(layerName, options.layers)) || nameIsListed(layerName, options.excludeLayers)) {
+        return false;
+    }
+    if ((!options.instances.empty() && !nameIsListed(inst->name, options.instances)) || nameIsListed(inst->name, options.excludeInstances)) {
+        return false;
+    }
+    bool inGroups = options.groups.empty();
+    for (uint32_t g = inst->group_index; g != k_invalid_group_index; g = scene->groups[g].parent_group_index) {
+        if (nameIsListed(scene->groups[g].name, options.excludeGroups)) {
+            return false;
+        }
+        inGroups |= nameIsListed(scene->groups[g].name, options.groups);
+    }
+    return inGroups;
+}
+
+// model=N: only that model's mesh, as the default prim. This is what the payloads of a payloads=1 read load.
+static bool MagicavoxelRead_SingleModel(const ogt_vox_scene *scene, SdfLayerHandle lyr, const MagicavoxelReadOptions &options) {
+    uint64_t index = (uint64_t)options.conversion.model;
+    if (index >= scene->num_models || !scene->models[index]) {
+        TF_RUNTIME_ERROR("No model %llu in %s", (unsigned long long)index, options.source->GetIdentifier().c_str());
+        return false;
+    }
+    SdfPath path("/model");
+    ModelMesh modelMesh = meshSceneModel(scene, (uint32_t)index, options, 0, scenePaletteHash(scene), previousMeshHash(options.source, path));
+    writeModelMesh(lyr, path, modelMesh, options);
+    lyr->SetDefaultPrim(TfToken("model"));
+    return true;
+}
+
+static bool MagicavoxelRead_impl(const ogt_vox_scene *scene, SdfLayerHandle lyr, const MagicavoxelReadOptions &options) {
     // scene->palette
     // cameras, groups, instances have layer indexes
     // a group has a parent, a group has many children, a group has an xform
     // an instance has a group as a parent, refers to a model (first frame) and animation.
     // an animation is a list of keyframes to model indexes.
-    std::map<uint32_t, SdfPrimSpecHandle> groupPrims;
+    if (options.conversion.model >= 0) {
+        return MagicavoxelRead_SingleModel(scene, lyr, options);
+    }
 
     auto modelsPrim = SdfCreatePrimInLayer(lyr, SdfPath("/models"));
     modelsPrim->SetSpecifier(SdfSpecifierClass);
     modelsPrim->SetTypeName("Scope");
 
-    for (uint32_t i = 0; i < scene->num_models; i++) {
+    // Kitbashed scenes often contain many copies of the same model, sometimes rotated. Mesh each one once.
+    // That needs every model's voxels, so models fetched through a reader are each their own prototype.
+    std::vector<ModelPrototype> prototypes;
+    if (options.reader) {
+        for (uint32_t i = 0; i < scene->num_models; i++) {
+            prototypes.push_back({ i, 0, 0 });
+        }
+    } else {
+        prototypes = dedupeModels(scene);
+    }
+    uint64_t paletteHash = scenePaletteHash(scene);
+
+    auto modelVoxelCount = [&](uint32_t i) -> size_t {
         const ogt_vox_model *model = scene->models[i];
+        if (options.reader) {
+            return options.reader->numModelVoxels(i);
+        }
+        return model->deferred_voxel_data ? model->num_deferred_voxels
+             : model->packed_voxel_data ? model->num_packed_voxels
+             : (size_t)model->size_x * model->size_y * model->size_z;
+    };
+
+    // How many of these models may be meshed ahead of the one whose specs are being written.
+    auto pipelineWindow = [&](const std::vector<uint32_t> &models) -> size_t {
+        size_t window = k_pipeline_window;
+        if (options.memoryBudget != 0) {
+            size_t largest = 1;
+            for (uint32_t i : models) {
+                largest = std::max(largest, modelWorkingSetEstimate(scene->models[i], modelVoxelCount(i)));
+            }
+            // one more model than the window may be in flight, meshed by the reading thread itself
+            size_t fits = options.memoryBudget / largest;
+            window = std::min(window, fits > 1 ? fits - 1 : 1);
+        }
+        return window;
+    };
+
+    // Instances the layer, group and instance filters leave out are skipped altogether.
+    std::vector<bool> includedInstance(scene->num_instances, true);
+    if (options.conversion.filtersInstances()) {
+        for (uint32_t i = 0; i < scene->num_instances; i++) {
+            includedInstance[i] = instanceIsIncluded(scene, &scene->instances[i], options.conversion);
+        }
+    }
+
+    // Merged instances are meshed straight from their models' voxels, so a model whose instances are all merged
+    // doesn't need a mesh of its own. Merging needs every voxel up front, so it's left out of payloads=1 reads.
+    std::vector<bool> mergedInstance(scene->num_instances, false);
+    std::vector<MergedInstances> mergedGroups;
+    if (options.conversion.mergeInstances && !options.conversion.modelPayloads) {
+        mergedGroups = planMergedInstances(scene, modelVoxelCount, includedInstance, mergedInstance);
+    }
+
+    // cullSeams=1: instances with faces hidden by the voxels of other instances get a mesh of their own, culled
+    // against the whole scene, as are merged meshes. The others keep referencing their model's mesh.
+    std::map<uint32_t, VoxelChunkedMesh> seamMeshes;
+    std::unique_ptr<VoxelColorMap> world;
+    if (options.conversion.cullSeams && options.meshModels && !options.conversion.modelPayloads) {
+        std::vector<uint32_t> placed, culled, culledModels;
+        for (uint32_t i = 0; i < scene->num_instances; i++) {
+            const ogt_vox_instance *inst = &scene->instances[i];
+            int32_t rows[4][3];
+            if (includedInstance[i] && scene->models[inst->model_index] && instanceIsVisible(scene, inst) &&
+                instanceWorldTransform(scene, inst, rows)) {
+                placed.push_back(i);
+                if (!mergedInstance[i]) {
+                    culled.push_back(i);
+                    culledModels.push_back(inst->model_index);
+                }
+            }
+        }
+        if (placed.size() > 1) {
+            world.reset(new VoxelColorMap(worldVoxelsOfInstances(scene, placed, modelVoxelCount, options)));
+            VoxelOrderedPipeline<std::pair<bool, VoxelChunkedMesh>>(culled.size(), pipelineWindow(culledModels),
+                [&](size_t n) {
+                    SdfMeshArrays arrays;
+                    bool seam = meshSeamCulledInstance(scene, culled[n], *world, options, &arrays);
+                    if (!seam) {
+                        return std::make_pair(false, VoxelChunkedMesh());
+                    }
+                    return std::make_pair(true, VoxelChunkedMesh(arrays, options.conversion.chunkSize, options.conversion.splitComponents));
+                },
+                [&](size_t n, const std::pair<bool, VoxelChunkedMesh> &result) {
+                    if (result.first) {
+                        seamMeshes.emplace(culled[n], result.second);
+                    }
+                });
+        }
+    }
+
+    // Models that no instance references any more aren't meshed, unless they had no instances to begin with.
+    // With filters, only the models of the included instances are.
+    std::vector<uint32_t> referencingCount(scene->num_models, 0), replacedCount(scene->num_models, 0);
+    for (uint32_t i = 0; i < scene->num_instances; i++) {
+        uint32_t model_index = prototypes[scene->instances[i].model_index].model_index;
+        bool replaced = !includedInstance[i] || mergedInstance[i] || seamMeshes.count(i) != 0;
+        (replaced ? replacedCount : referencingCount)[model_index]++;
+    }
+
+    std::vector<uint32_t> meshedModels;
+    for (uint32_t i = 0; i < scene->num_models; i++) {
+        bool referenced = referencingCount[i] != 0 || (replacedCount[i] == 0 && !options.conversion.filtersInstances());
+        if (scene->models[i] && prototypes[i].model_index == i && referenced) {
+            meshedModels.push_back(i);
+        }
+    }
+    if (options.meshModels && options.conversion.modelPayloads) {
+        // leave the meshing to whichever payloads the stage loads
+        for (uint32_t i : meshedModels) {
+            char pathc[64];
+            snprintf(pathc, sizeof(pathc), "/models/m%u", i);
+            writeModelPayloadPrim(scene->models[i], lyr, SdfPath(pathc), modelPayloadAssetPath(options.source, i), options.conversion);
+        }
+        meshedModels.clear();
+    } else if (!options.meshModels) {
+        for (uint32_t i : meshedModels) {
+            char pathc[64];
+            snprintf(pathc, sizeof(pathc), "/models/m%u", i);
+            VoxelModelRepresentation(SdfMeshArrays(), 0, options.conversion).writePrim(lyr, SdfPath(pathc));
+        }
+        meshedModels.clear();
+    }
+
+    // Mesh the next few models on worker threads while this one's specs are written.
+    size_t window = pipelineWindow(meshedModels);
+    std::vector<SdfPath> meshedPaths;
+    std::vector<uint64_t> previousHashes;
+    for (uint32_t i : meshedModels) {
         char pathc[64];
         snprintf(pathc, sizeof(pathc), "/models/m%u", i);
-        SdfPath path(pathc);
-        createModel(model, &scene->palette, lyr, path);
+        meshedPaths.push_back(SdfPath(pathc));
+        previousHashes.push_back(previousMeshHash(options.source, meshedPaths.back()));
+    }
+    // Chunks are split on the workers too, leaving only the spec writes to this thread.
+    VoxelOrderedPipeline<ModelMesh>(meshedModels.size(), window,
+        [&](size_t n) {
+            uint32_t i = meshedModels[n];
+            return meshSceneModel(scene, i, options, prototypes[i].hash, paletteHash, previousHashes[n]);
+        },
+        [&](size_t n, const ModelMesh &modelMesh) {
+            writeModelMesh(lyr, meshedPaths[n], modelMesh, options);
+        });
+
+    std::map<uint32_t, SdfPrimSpecHandle> groupPrims;
+    VoxelOrderedPipeline<VoxelChunkedMesh>(mergedGroups.size(), window,
+        [&](size_t n) {
+            if (!options.meshModels) {
+                return VoxelChunkedMesh(SdfMeshArrays(), options.conversion.chunkSize, options.conversion.splitComponents);
+            }
+            return VoxelChunkedMesh(meshMergedInstances(scene, mergedGroups[n], world.get(), options),
+                                    options.conversion.chunkSize, options.conversion.splitComponents);
+        },
+        [&](size_t n, const VoxelChunkedMesh &mesh) {
+            auto groupPrim = createGroup(scene, lyr, groupPrims, mergedGroups[n].group_index);
+            // in the group's space, like the instances it replaces, so it moves with whatever references the layer
+            mesh.writePrim(lyr, groupPrim->GetPath().AppendChild(TfToken("merged")));
+        });
+
+    // Instances of the same model under the same group share a PointInstancer, which is written where the first
+    // of them would have been.
+    std::vector<int64_t> instanceBatch(scene->num_instances, -1);
+    std::vector<std::vector<uint32_t>> batches;
+    if (options.conversion.instancing == k_instancing_point_instancer) {
+        std::map<std::pair<uint32_t, uint32_t>, std::vector<uint32_t>> groupModelInstances;
+        for (uint32_t i = 0; i < scene->num_instances; i++) {
+            const ogt_vox_instance *inst = &scene->instances[i];
+            if (!includedInstance[i] || mergedInstance[i] || seamMeshes.count(i) != 0 ||
+                !pointInstancerCanPlace(scene, inst, prototypes[inst->model_index])) {
+                continue;
+            }
+            groupModelInstances[{ inst->group_index, prototypes[inst->model_index].model_index }].push_back(i);
+        }
+        for (auto &entry : groupModelInstances) {
+            if (entry.second.size() < k_point_instancer_min_instances) {
+                continue;
+            }
+            for (uint32_t i : entry.second) {
+                instanceBatch[i] = (int64_t)batches.size();
+            }
+            batches.push_back(std::move(entry.second));
+        }
+    }
+
+    // bvh=1: the instance prims of big flat groups are spread over a BVH of Xforms, so that bounds queries and
+    // culling can skip whole branches.
+    std::map<uint32_t, SdfPath> instanceParents;
+    if (options.conversion.bvh) {
+        std::map<uint32_t, std::vector<InstanceBounds>> groupInstances;
+        for (uint32_t i = 0; i < scene->num_instances; i++) {
+            if (includedInstance[i] && !mergedInstance[i] && instanceBatch[i] < 0) {
+                groupInstances[scene->instances[i].group_index].push_back(instanceBounds(scene, i));
+            }
+        }
+        for (auto &entry : groupInstances) {
+            if (entry.second.size() >= k_bvh_min_instances) {
+                auto groupPrim = createGroup(scene, lyr, groupPrims, entry.first);
+                writeBvhNodes(lyr, groupPrim->GetPath(), entry.second.begin(), entry.second.end(), instanceParents);
+            }
+        }
     }
 
     for (uint32_t i = 0; i < scene->num_instances; i++) {
         const ogt_vox_instance *inst = &scene->instances[i];
+        if (!includedInstance[i] || mergedInstance[i]) {
+            continue;
+        }
 
         auto parentPrim = createGroup(scene, lyr, groupPrims, inst->group_index);
         auto parentPath = parentPrim->GetPath();
+        const ModelPrototype &proto = prototypes[inst->model_index];
         char pathc[64];
+        snprintf(pathc, sizeof(pathc), "/models/m%u", proto.model_index);
+        SdfPath modelPath(pathc);
+
+        if (instanceBatch[i] >= 0) {
+            const std::vector<uint32_t> &batch = batches[instanceBatch[i]];
+            if (batch[0] == i) {
+                snprintf(pathc, sizeof(pathc), "instances_m%u", proto.model_index);
+                writePointInstancer(scene, lyr, parentPath.AppendChild(TfToken(pathc)), modelPath, prototypes, batch);
+            }
+            continue;
+        }
+
+        auto bvhParent = instanceParents.find(i);
+        if (bvhParent != instanceParents.end()) {
+            parentPath = bvhParent->second;
+        }
         snprintf(pathc, sizeof(pathc), "inst%u", i);
         auto path = parentPath.AppendChild(TfToken(pathc));
         auto prim = SdfCreatePrimInLayer(lyr, path);
         prim->SetSpecifier(SdfSpecifierDef);
         prim->SetTypeName("Xform");
+        prim->SetKind(TfToken("component"));
         if (inst->name) {
             prim->SetField(TfToken("displayName"), std::string(inst->name));
         }
 
-        createTransformForPrim(prim, &inst->transform);
+        auto seamMesh = seamMeshes.find(i);
+        if (seamMesh != seamMeshes.end()) {
+            // meshed from the instance's own model, not its prototype
+            createTransformForPrim(prim, &inst->transform);
+            createVisibilityForPrim(prim, inst->hidden);
+            seamMesh->second.writePrim(lyr, path.AppendChild(TfToken("model")));
+            continue;
+        }
+
+        ogt_vox_transform transform = instanceTransform(scene, inst, proto);
+        createTransformForPrim(prim, &transform);
         createVisibilityForPrim(prim, inst->hidden);
 
-        snprintf(pathc, sizeof(pathc), "/models/m%u", inst->model_index);
-        SdfPath modelPath(pathc);
         auto modelPrim = SdfCreatePrimInLayer(lyr, path.AppendChild(TfToken("model")));
         modelPrim->GetReferenceList().Append(SdfReference("", modelPath));
+        if (options.meshModels && options.conversion.modelPayloads && scene->models[proto.model_index]) {
+            // bounds queries stop at the instance, without loading the model's payload
+            auto attr = SdfAttributeSpec::New(prim, "extentsHint", SdfValueTypeNames->Float3Array);
+            attr->SetDefaultValue(VtValue(modelBoxExtent(scene->models[proto.model_index])));
+        }
+        if (options.conversion.instancing != k_instancing_none) {
+            modelPrim->SetInstanceable(true);
+        }
     }
 
+    // with filters, only the root and the groups holding included instances are authored
     for (uint32_t i = 0; i < scene->num_groups; i++) {
-        createGroup(scene, lyr, groupPrims, i);
+        if (!options.conversion.filtersInstances() || scene->groups[i].parent_group_index == k_invalid_group_index) {
+            createGroup(scene, lyr, groupPrims, i);
+        }
     }
 
     lyr->SetDefaultPrim(TfToken("root"));
@@ -176,9 +1589,54 @@ static bool MagicavoxelRead_impl(const ogt_vox_scene *scene, SdfLayerHandle lyr)
     return true;
 }
 
-bool SdfMagicaVoxelRead(SdfLayerHandle layer, const unsigned char *contents, size_t contents_size) {
-    const ogt_vox_scene *scene = ogt_vox_read_scene_with_flags(contents, contents_size, k_read_scene_flags_groups | k_read_scene_flags_keyframes | k_read_scene_flags_keep_empty_models_instances | k_read_scene_flags_keep_duplicate_models);
-    bool result = MagicavoxelRead_impl(scene, layer);
+static const uint32_t k_read_flags = k_read_scene_flags_groups | k_read_scene_flags_keyframes | k_read_scene_flags_keep_empty_models_instances | k_read_scene_flags_keep_duplicate_models | k_read_scene_flags_sparse_models;
+
+static size_t readMemoryBudget() {
+    return (size_t)TfGetEnvSetting(USDVOXEL_READ_BUDGET_MB) * 1024 * 1024;
+}
+
+bool SdfMagicaVoxelStreaming() {
+    return readMemoryBudget() != 0;
+}
+
+bool SdfMagicaVoxelRead(SdfLayerHandle layer, SdfLayerHandle source, const unsigned char *contents, size_t contents_size, const UsdVoxelReadOptions &readOptions) {
+    uint32_t flags = k_read_flags;
+    MagicavoxelReadOptions options;
+    options.conversion = readOptions;
+    options.source = source;
+    // Streaming: only the hierarchy is read up front. Each model is decoded, meshed and freed in turn.
+    // A single model, or payloads, don't need the other models decoded at all.
+    options.memoryBudget = readMemoryBudget();
+    if (options.memoryBudget != 0 || readOptions.model >= 0 || readOptions.modelPayloads) {
+        flags |= k_read_scene_flags_deferred_models;
+    }
+    const ogt_vox_scene *scene = ogt_vox_read_scene_with_flags(contents, contents_size, flags);
+    if (!scene) {
+        return false;
+    }
+    bool result = MagicavoxelRead_impl(scene, layer, options);
+    ogt_vox_destroy_scene(scene);
+    return result;
+}
+
+bool SdfMagicaVoxelReadAsset(SdfLayerHandle layer, SdfLayerHandle source, const UsdVoxelVoxAssetReader &reader, const UsdVoxelReadOptions &readOptions, bool meshModels) {
+    // the scene graph is parsed from a copy of the file without any voxels; models are placeholders until meshed
+    const std::vector<uint8_t> &sceneContents = reader.sceneContents();
+    const ogt_vox_scene *scene = ogt_vox_read_scene_with_flags(sceneContents.data(), sceneContents.size(), k_read_flags | k_read_scene_flags_deferred_models);
+    if (!scene) {
+        return false;
+    }
+    if (!TF_VERIFY(scene->num_models == reader.numModels())) {
+        ogt_vox_destroy_scene(scene);
+        return false;
+    }
+    MagicavoxelReadOptions options;
+    options.memoryBudget = readMemoryBudget();
+    options.conversion = readOptions;
+    options.source = source;
+    options.reader = &reader;
+    options.meshModels = meshModels;
+    bool result = MagicavoxelRead_impl(scene, layer, options);
     ogt_vox_destroy_scene(scene);
     return result;
 }
\ No newline at end of file
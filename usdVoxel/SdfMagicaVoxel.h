@@ -6,6 +6,19 @@
 #include "pxr/usd/sdf/types.h"
 #include <stdint.h>
 
-bool SdfMagicaVoxelRead(pxr::SdfLayerHandle layer, const unsigned char *contents, size_t contents_size);
+#include "readOptions.h"
+
+class UsdVoxelVoxAssetReader;
+
+// Authors the scene into layer. source is the layer being read, which may be layer itself: model payloads
+// point back into its file, and models whose meshes it already holds (from before a reload) aren't meshed again.
+bool SdfMagicaVoxelRead(pxr::SdfLayerHandle layer, pxr::SdfLayerHandle source, const unsigned char *contents, size_t contents_size, const UsdVoxelReadOptions &options);
+
+// Like SdfMagicaVoxelRead, but fetches each model's voxels through the reader only when it's meshed.
+// If meshModels is false, only the scene hierarchy is read and authored.
+bool SdfMagicaVoxelReadAsset(pxr::SdfLayerHandle layer, pxr::SdfLayerHandle source, const UsdVoxelVoxAssetReader &reader, const UsdVoxelReadOptions &options, bool meshModels);
+
+// True if USDVOXEL_READ_BUDGET_MB asks for .vox files to be converted in streaming mode.
+bool SdfMagicaVoxelStreaming();
 
 #endif
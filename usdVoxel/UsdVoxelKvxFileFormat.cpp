@@ -7,12 +7,20 @@
 // A KVX file (typically) has 5 levels of detail. This can be selected as a variant.
 
 #include "cubePlacers.h"
+#include "conversionCache.h"
+#include "meshCache.h"
+#include "meshChunks.h"
+#include "readOptions.h"
+#include "voxelHash.h"
+#include "voxelPipeline.h"
+#include "voxelRepresentation.h"
 
 #include "pxr/base/gf/vec3f.h"
 #include "pxr/base/tf/refPtr.h"
 #include "pxr/base/tf/token.h"
 #include "pxr/base/tf/weakPtr.h"
 #include "pxr/base/vt/types.h"
+#include "pxr/usd/pcp/dynamicFileFormatContext.h"
 #include "pxr/usd/pcp/dynamicFileFormatDependencyData.h"
 #include "pxr/usd/pcp/dynamicFileFormatInterface.h"
 #include "pxr/usd/sdf/abstractData.h"
@@ -28,6 +36,9 @@
 
 #include "kvx.h"
 
+#include <algorithm>
+#include <atomic>
+#include <math.h>
 #include <stdio.h>
 #include <iostream>
 
@@ -62,7 +73,117 @@ TF_DEFINE_PUBLIC_TOKENS(
     UsdVoxelKvxTokens, 
     USD_VOXEL_KVX_TOKENS);
 
-class UsdVoxelKvxFileFormat : public SdfFileFormat {
+// Number of x columns meshed per task, and how many bands may be meshed ahead of the one being merged.
+static const uint32_t k_kvx_band_columns = 16;
+static const size_t k_kvx_pipeline_window = 16;
+
+// A voxel coordinate bound, kept well within int32_t.
+static int32_t kvxBoxBound(double v) {
+    return (int32_t)std::max(-1e9, std::min(1e9, v));
+}
+
+// The voxels of a level whose centers are inside the crop box. In world units, the box is in the layer's
+// coordinates, where voxel (x, y, z) is centered on (x, -z, y) minus the pivot.
+static KvxBox kvxCropBox(const KvxLevel &level, const UsdVoxelReadOptions &options) {
+    double lo[3], hi[3];
+    if (options.cropVoxelUnits) {
+        for (int axis = 0; axis < 3; axis++) {
+            lo[axis] = options.cropMin[axis];
+            hi[axis] = options.cropMax[axis];
+        }
+    } else {
+        double xpivot = level.xpivot / 256.0, ypivot = level.ypivot / 256.0, zpivot = level.zpivot / 256.0;
+        lo[0] = options.cropMin[0] + xpivot;
+        hi[0] = options.cropMax[0] + xpivot;
+        lo[1] = options.cropMin[2] + ypivot;
+        hi[1] = options.cropMax[2] + ypivot;
+        lo[2] = zpivot - options.cropMax[1];
+        hi[2] = zpivot - options.cropMin[1];
+    }
+    KvxBox box;
+    for (int axis = 0; axis < 3; axis++) {
+        box.lo[axis] = kvxBoxBound(ceil(lo[axis]));
+        box.hi[axis] = kvxBoxBound(floor(hi[axis]));
+    }
+    return box;
+}
+
+// Meshes level 0 (the only one the mesh placer keeps) in bands of columns on worker threads,
+// appending each band to the final mesh in order as soon as it's ready. Only the bands the crop box
+// overlaps are read. voxels is set to the number of voxels meshed.
+static bool meshKvx(const unsigned char *contents, size_t contents_size, const UsdVoxelReadOptions &options, SdfMeshArrays *arrays,
+                    size_t *voxels) {
+    KvxFile file;
+    if (!KvxParse(contents, contents_size, file)) {
+        return false;
+    }
+    SdfMeshCubePlacer meshCubePlacer;
+    std::atomic<size_t> placed(0);
+    if (file.num_levels > 0) {
+        const KvxLevel &level = file.levels[0];
+        KvxBox box;
+        uint32_t xBegin = 0, xEnd = level.xsiz;
+        if (options.crop) {
+            box = kvxCropBox(level, options);
+            KvxClampRange(box.lo[0], box.hi[0], &xBegin, &xEnd);
+        }
+        size_t numBands = (xEnd - xBegin + k_kvx_band_columns - 1) / k_kvx_band_columns;
+        std::atomic<bool> success(true);
+
+        VoxelOrderedPipeline<SdfMeshArrays>(numBands, k_kvx_pipeline_window,
+            [&](size_t band) {
+                SdfMeshCubePlacer bandPlacer;
+                uint32_t x0 = xBegin + band * k_kvx_band_columns;
+                size_t bandVoxels = 0;
+                if (!KvxReadColumns(file, 0, x0, std::min(xEnd, x0 + k_kvx_band_columns), bandPlacer, options.crop ? &box : nullptr,
+                                    &bandVoxels)) {
+                    success = false;
+                }
+                placed += bandVoxels;
+                return bandPlacer.takeArrays();
+            },
+            [&](size_t /* band */, const SdfMeshArrays &bandArrays) {
+                meshCubePlacer.append(bandArrays);
+            });
+
+        if (!success) {
+            return false;
+        }
+    }
+    *arrays = meshCubePlacer.takeArrays();
+    *voxels = placed;
+    return true;
+}
+
+// Verifies a mesh cache hit on the file's mesh key: level 0's dims and the number of voxels meshed from it, and an
+// independent hash of the contents and the crop box. voxels is that number if it's already known, or -1 to count it.
+static UsdVoxelMeshCheck kvxMeshCheck(const unsigned char *contents, size_t contents_size, VoxelContentHashes &hashes,
+                                      const UsdVoxelReadOptions &options, const double *crop, size_t cropSize,
+                                      size_t voxels = (size_t)-1) {
+    UsdVoxelMeshCheck check;
+    KvxFile file;
+    if (KvxParse(contents, contents_size, file) && file.num_levels > 0) {
+        const KvxLevel &level = file.levels[0];
+        check.dims[0] = level.xsiz;
+        check.dims[1] = level.ysiz;
+        check.dims[2] = level.zsiz;
+        if (voxels == (size_t)-1) {
+            KvxBox box;
+            if (options.crop) {
+                box = kvxCropBox(level, options);
+            }
+            voxels = KvxCountVoxels(level, options.crop ? &box : nullptr);
+        }
+        check.voxels = voxels;
+    }
+    check.hash = hashes.check();
+    if (options.crop) {
+        check.hash = VoxelHashCombine(check.hash, VoxelHash64Check(crop, cropSize));
+    }
+    return check;
+}
+
+class UsdVoxelKvxFileFormat : public SdfFileFormat, public PcpDynamicFileFormatInterface {
 public:
     UsdVoxelKvxFileFormat()
     : SdfFileFormat(
@@ -77,26 +198,53 @@ public:
     bool CanRead(const std::string &filePath) const override {
         return true;
     }
+
+    // The usdVoxelArgs metadata of the prim with the payload adds to the layer's file format arguments, so each
+    // combination is its own layer (and conversion cache entry). Pcp only asks dynamic file formats about payloads.
+    // No context data is needed to tell which field changes matter.
+    void ComposeFieldsForFileFormatArguments(const std::string &assetPath, const PcpDynamicFileFormatContext &context,
+                                             FileFormatArguments *args, VtValue * /* dependencyContextData */) const override {
+        UsdVoxelComposeFileFormatArguments(assetPath, context, args);
+    }
+    bool CanFieldChangeAffectFileFormatArguments(const TfToken &field, const VtValue &oldValue, const VtValue &newValue,
+                                                 const VtValue & /* dependencyContextData */) const override {
+        return UsdVoxelCanFieldChangeAffectFileFormatArguments(field, oldValue, newValue);
+    }
     bool Read(SdfLayer *layer, const std::string &resolvedPath, bool metadataOnly) const override {
         if (!TF_VERIFY(layer)) {
             return false;
         }
 
         const FileFormatArguments &args = layer->GetFileFormatArguments();
-        auto data = InitData(args);
-        _SetLayerData(layer, data);
+        UsdVoxelReadOptions options = UsdVoxelReadOptions::fromArguments(args);
 
         auto asset = ArGetResolver().OpenAsset(ArResolvedPath(resolvedPath));
         if (!asset) {
             return false;
         }
 
-        // read the entire asset in memory
+        // Ar memory-maps local files, so this doesn't need the whole file to fit in RAM:
+        // only the pages the parser touches are read in.
         auto buf = asset->GetBuffer();
         if (!buf) {
             return false;
         }
 
+        const char *contents = buf.get();
+        size_t contents_size = asset->GetSize();
+
+        // both caches are keyed by these, so each is only computed once
+        VoxelContentHashes contentHashes(contents, contents_size);
+        UsdVoxelConversionCache cache(UsdVoxelKvxTokens->Id, UsdVoxelKvxTokens->Version, contentHashes, args);
+        if (cache.read(layer, metadataOnly)) {
+            layer->SetPermissionToSave(false);
+            layer->SetPermissionToEdit(false);
+            return true;
+        }
+
+        auto data = InitData(args);
+        _SetLayerData(layer, data);
+
         // Create specs directly on the SdfData object
         // Interface to it through SdfLayer
 
@@ -108,18 +256,36 @@ public:
         SdfLayerHandle lyr(layer);
 
         SdfPointInstanceCubePlacer pointsCubePlacer;
-        SdfMeshCubePlacer meshCubePlacer;
 
-        const char *contents = buf.get();
-        size_t contents_size = asset->GetSize();
-        bool success;
-        success = KvxRead((const unsigned char*)contents, contents_size, meshCubePlacer);
+        // The same .kvx is often opened through other paths or file format arguments; share its mesh.
+        UsdVoxelMeshCache &meshCache = UsdVoxelMeshCache::get();
+        uint64_t meshKey = VoxelHashCombine(contentHashes.hash(), VoxelHash64("kvx", 3));
+        double crop[7] = { options.cropMin[0], options.cropMin[1], options.cropMin[2],
+                           options.cropMax[0], options.cropMax[1], options.cropMax[2], options.cropVoxelUnits ? 1.0 : 0.0 };
+        if (options.crop) {
+            meshKey = VoxelHashCombine(meshKey, VoxelHash64(crop, sizeof(crop)));
+        }
+        SdfMeshArrays arrays;
+        bool success = meshCache.find(meshKey, [&]() {
+            return kvxMeshCheck((const unsigned char*)contents, contents_size, contentHashes, options, crop, sizeof(crop));
+        }, &arrays);
+        if (!success) {
+            size_t voxels = 0;
+            success = meshKvx((const unsigned char*)contents, contents_size, options, &arrays, &voxels);
+            if (success) {
+                meshCache.insert(meshKey, kvxMeshCheck((const unsigned char*)contents, contents_size, contentHashes, options,
+                                                       crop, sizeof(crop), voxels), arrays);
+            }
+        }
         if (success) {
-            meshCubePlacer.writePrim(lyr, SdfPath("/mesh"));
+            // a .kvx only stores the voxels that can be seen, so its solid voxel count isn't known
+            VoxelModelRepresentation(arrays, 0, options).writePrim(lyr, SdfPath("/mesh"));
         }
 
         layer->SetDefaultPrim(TfToken("mesh"));
 
+        cache.write(*layer);
+
         layer->SetPermissionToSave(false);
         layer->SetPermissionToEdit(false);
 
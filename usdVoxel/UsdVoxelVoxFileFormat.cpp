@@ -1,12 +1,15 @@
 // 2024 - Danny Spencer
 
 #include "cubePlacers.h"
+#include "conversionCache.h"
 
 #include "pxr/base/gf/vec3f.h"
+#include "pxr/base/tf/pathUtils.h"
 #include "pxr/base/tf/refPtr.h"
 #include "pxr/base/tf/token.h"
 #include "pxr/base/tf/weakPtr.h"
 #include "pxr/base/vt/types.h"
+#include "pxr/usd/pcp/dynamicFileFormatContext.h"
 #include "pxr/usd/pcp/dynamicFileFormatDependencyData.h"
 #include "pxr/usd/pcp/dynamicFileFormatInterface.h"
 #include "pxr/usd/sdf/abstractData.h"
@@ -21,6 +24,8 @@
 #include "pxr/usd/ar/resolver.h"
 
 #include "SdfMagicaVoxel.h"
+#include "readOptions.h"
+#include "voxAssetReader.h"
 
 #include <stdio.h>
 #include <iostream>
@@ -40,7 +45,29 @@ TF_DEFINE_PUBLIC_TOKENS(
     UsdVoxelVoxTokens, 
     USD_VOXEL_VOX_TOKENS);
 
-class UsdVoxelVoxFileFormat : public SdfFileFormat {
+class UsdVoxelVoxFileFormat : public SdfFileFormat, public PcpDynamicFileFormatInterface {
+    // On a reload the layer still holds the previous read. The conversion is then authored into a scratch layer,
+    // and swapped in by finishConversion: Sdf diffs it against the current data, so only the specs that actually
+    // changed send change notices. A first read authors straight into the layer.
+    SdfLayerRefPtr beginConversion(SdfLayer *layer, const FileFormatArguments &args) const {
+        if (!layer->GetRootPrims().empty()) {
+            return SdfLayer::CreateAnonymous("usdVoxel.usda");
+        }
+        auto data = InitData(args);
+        _SetLayerData(layer, data);
+        return SdfLayerRefPtr();
+    }
+
+    void finishConversion(SdfLayer *layer, const SdfLayerRefPtr &staging, const FileFormatArguments &args) const {
+        SdfLayerHandle lyr = staging ? SdfLayerHandle(staging) : SdfLayerHandle(layer);
+        lyr->GetPseudoRoot()->SetField(TfToken("upAxis"), TfToken("Z"));
+        if (staging) {
+            auto data = InitData(args);
+            data->CopyFrom(_GetLayerData(*staging));
+            _SetLayerData(layer, data);
+        }
+    }
+
 public:
     UsdVoxelVoxFileFormat()
     : SdfFileFormat(
@@ -55,41 +82,90 @@ public:
     bool CanRead(const std::string &filePath) const override {
         return true;
     }
+
+    // The usdVoxelArgs metadata of the prim with the payload adds to the layer's file format arguments, so each
+    // combination is its own layer (and conversion cache entry). Pcp only asks dynamic file formats about payloads.
+    // No context data is needed to tell which field changes matter.
+    void ComposeFieldsForFileFormatArguments(const std::string &assetPath, const PcpDynamicFileFormatContext &context,
+                                             FileFormatArguments *args, VtValue * /* dependencyContextData */) const override {
+        UsdVoxelComposeFileFormatArguments(assetPath, context, args);
+    }
+    bool CanFieldChangeAffectFileFormatArguments(const TfToken &field, const VtValue &oldValue, const VtValue &newValue,
+                                                 const VtValue & /* dependencyContextData */) const override {
+        return UsdVoxelCanFieldChangeAffectFileFormatArguments(field, oldValue, newValue);
+    }
     bool Read(SdfLayer *layer, const std::string &resolvedPath, bool metadataOnly) const override {
         if (!TF_VERIFY(layer)) {
             return false;
         }
 
         const FileFormatArguments &args = layer->GetFileFormatArguments();
-        auto data = InitData(args);
-        _SetLayerData(layer, data);
+        UsdVoxelReadOptions options = UsdVoxelReadOptions::fromArguments(args);
 
         auto asset = ArGetResolver().OpenAsset(ArResolvedPath(resolvedPath));
         if (!asset) {
             return false;
         }
 
-        // read the entire asset in memory
+        // The on-disk cache is keyed by a hash of the whole file. Without it, metadata-only, streaming, single model
+        // and payload reads go through the chunk index instead, and only fetch the parts of the file they use.
+        bool partial = metadataOnly || SdfMagicaVoxelStreaming() || options.modelPayloads || options.model >= 0;
+        if (!UsdVoxelConversionCache::isConfigured() && partial) {
+            UsdVoxelVoxAssetReader reader;
+            if (!reader.open(asset)) {
+                return false;
+            }
+            SdfLayerRefPtr staging = beginConversion(layer, args);
+            SdfLayerHandle lyr = staging ? SdfLayerHandle(staging) : SdfLayerHandle(layer);
+            SdfMagicaVoxelReadAsset(lyr, SdfLayerHandle(layer), reader, options, !metadataOnly);
+            finishConversion(layer, staging, args);
+            layer->SetPermissionToSave(false);
+            layer->SetPermissionToEdit(false);
+            return true;
+        }
+
+        // Ar memory-maps local files, so this doesn't need the whole file to fit in RAM:
+        // only the pages the parser touches are read in.
         auto buf = asset->GetBuffer();
         if (!buf) {
             return false;
         }
 
+        const char *contents = buf.get();
+        size_t contents_size = asset->GetSize();
+
+        // payloads=1 layers refer back to the file by its name, so a byte-identical copy under another name needs
+        // its own entry; streamed conversions (USDVOXEL_READ_BUDGET_MB) are kept apart from whole ones too
+        std::string extraKey;
+        if (options.modelPayloads) {
+            std::string layerPath;
+            FileFormatArguments identifierArgs;
+            SdfLayer::SplitIdentifier(layer->GetIdentifier(), &layerPath, &identifierArgs);
+            extraKey = "payloads:" + TfGetBaseName(layerPath);
+        }
+        if (SdfMagicaVoxelStreaming()) {
+            extraKey += extraKey.empty() ? "streaming" : " streaming";
+        }
+        VoxelContentHashes contentHashes(contents, contents_size);
+        UsdVoxelConversionCache cache(UsdVoxelVoxTokens->Id, UsdVoxelVoxTokens->Version, contentHashes, args, extraKey);
+        if (cache.read(layer, metadataOnly)) {
+            layer->SetPermissionToSave(false);
+            layer->SetPermissionToEdit(false);
+            return true;
+        }
+
+        SdfLayerRefPtr staging = beginConversion(layer, args);
+
         // Create specs directly on the SdfData object
         // Interface to it through SdfLayer
 
-        bool zUp = false;
-        if (zUp) {
-            layer->GetPseudoRoot()->SetField(TfToken("upAxis"), TfToken("Z"));
-        }
+        SdfLayerHandle lyr = staging ? SdfLayerHandle(staging) : SdfLayerHandle(layer);
 
-        SdfLayerHandle lyr(layer);
+        SdfMagicaVoxelRead(lyr, SdfLayerHandle(layer), (unsigned char*)contents, contents_size, options);
 
-        const char *contents = buf.get();
-        size_t contents_size = asset->GetSize();
-        SdfMagicaVoxelRead(lyr, (unsigned char*)contents, contents_size);
-        
-        layer->GetPseudoRoot()->SetField(TfToken("upAxis"), TfToken("Z"));
+        finishConversion(layer, staging, args);
+
+        cache.write(*layer);
 
         layer->SetPermissionToSave(false);
         layer->SetPermissionToEdit(false);
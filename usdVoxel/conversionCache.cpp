@@ -0,0 +1,129 @@
+#include "conversionCache.h"
+#include "converterRevision.h"
+#include "voxelHash.h"
+
+#include "pxr/base/arch/fileSystem.h"
+#include "pxr/base/tf/diagnostic.h"
+#include "pxr/base/tf/envSetting.h"
+#include "pxr/base/tf/fileUtils.h"
+#include "pxr/base/tf/pathUtils.h"
+#include "pxr/base/tf/stringUtils.h"
+
+#include <stdio.h>
+
+using namespace pxr;
+
+TF_DEFINE_ENV_SETTING(USDVOXEL_CACHE_DIR, "",
+                      "Directory in which converted .vox/.kvx layers are cached as .usdc files. "
+                      "Caching is disabled when empty.");
+
+// The customLayerData key of the cached layer's verification string.
+static const char *k_cache_verification_key = "usdVoxelCacheVerification";
+
+static const TfToken &usdcFormatId() {
+    static const TfToken id("usdc");
+    return id;
+}
+
+UsdVoxelConversionCache::UsdVoxelConversionCache(const TfToken &formatId, const TfToken &formatVersion,
+                                                 VoxelContentHashes &contents,
+                                                 const SdfFileFormat::FileFormatArguments &args,
+                                                 const std::string &extraKey)
+    : contents(&contents)
+{
+    const std::string dir = TfGetEnvSetting(USDVOXEL_CACHE_DIR);
+    if (dir.empty()) {
+        return;
+    }
+
+    uint64_t key = contents.hash();
+    key = VoxelHashCombine(key, k_converter_revision);
+    key = VoxelHashCombine(key, VoxelHash64(formatVersion.GetText(), formatVersion.GetString().size()));
+    // FileFormatArguments is an ordered map, so equal arguments always hash the same.
+    for (const auto &arg : args) {
+        key = VoxelHashCombine(key, VoxelHash64(arg.first.data(), arg.first.size()));
+        key = VoxelHashCombine(key, VoxelHash64(arg.second.data(), arg.second.size()));
+    }
+    if (!extraKey.empty()) {
+        key = VoxelHashCombine(key, VoxelHash64(extraKey.data(), extraKey.size()));
+    }
+
+    // everything the key was made from, with the contents as their size and (see verification()) an independent hash
+    verificationPrefix = TfStringPrintf("%s %s %llu %zu", formatId.GetText(), formatVersion.GetText(),
+                                        (unsigned long long)k_converter_revision, contents.size());
+    for (const auto &arg : args) {
+        verificationPrefix += " " + arg.first + "=" + arg.second;
+    }
+    if (!extraKey.empty()) {
+        verificationPrefix += " " + extraKey;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s-%016llx.usdc", formatId.GetText(), (unsigned long long)key);
+    path = TfStringCatPaths(dir, name);
+}
+
+std::string UsdVoxelConversionCache::verification() const {
+    return TfStringPrintf("%s %016llx", verificationPrefix.c_str(), (unsigned long long)contents->check());
+}
+
+bool UsdVoxelConversionCache::isConfigured() {
+    return !TfGetEnvSetting(USDVOXEL_CACHE_DIR).empty();
+}
+
+bool UsdVoxelConversionCache::read(SdfLayer *layer, bool metadataOnly) const {
+    if (!isEnabled() || !TfIsFile(path)) {
+        return false;
+    }
+    auto usdc = SdfFileFormat::FindById(usdcFormatId());
+    if (!usdc) {
+        return false;
+    }
+    // Only the crate's metadata is read to check it, which is cheap.
+    SdfLayerRefPtr header = SdfLayer::OpenAsAnonymous(path, /* metadataOnly */ true);
+    if (!header) {
+        return false;
+    }
+    const VtDictionary customData = header->GetCustomLayerData();
+    auto it = customData.find(k_cache_verification_key);
+    if (it == customData.end() || !it->second.IsHolding<std::string>() ||
+        it->second.UncheckedGet<std::string>() != verification()) {
+        return false;
+    }
+    // The crate format installs its own (memory-mapped) data on the layer.
+    return usdc->Read(layer, path, metadataOnly);
+}
+
+void UsdVoxelConversionCache::write(SdfLayer &layer) const {
+    if (!isEnabled()) {
+        return;
+    }
+    VtDictionary customData = layer.GetCustomLayerData();
+    customData[k_cache_verification_key] = VtValue(verification());
+    layer.SetCustomLayerData(customData);
+
+    auto usdc = SdfFileFormat::FindById(usdcFormatId());
+    if (!usdc) {
+        return;
+    }
+    const std::string dir = TfGetPathName(path);
+    if (!TfIsDir(dir) && !TfMakeDirs(dir, -1, /* existOk */ true)) {
+        TF_WARN("Unable to create voxel cache directory '%s'", dir.c_str());
+        return;
+    }
+
+    std::string tmpPath;
+    int fd = ArchMakeTmpFile(dir, TfGetBaseName(path), &tmpPath);
+    if (fd == -1) {
+        return;
+    }
+    ArchCloseFile(fd);
+    if (!usdc->WriteToFile(layer, tmpPath)) {
+        TF_WARN("Unable to write voxel cache file '%s'", tmpPath.c_str());
+        TfDeleteFile(tmpPath);
+        return;
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        TfDeleteFile(tmpPath);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef __CONVERSION_CACHE_H__
+#define __CONVERSION_CACHE_H__
+
+#include "voxelHash.h"
+
+#include "pxr/base/tf/token.h"
+#include "pxr/usd/sdf/fileFormat.h"
+#include "pxr/usd/sdf/layer.h"
+
+#include <stdint.h>
+#include <string>
+
+// An opt-in, on-disk cache of converted voxel layers.
+//
+// When USDVOXEL_CACHE_DIR is set, each converted layer is saved there as a crate (.usdc) file,
+// keyed by the source file's content hash, the file format arguments and the converter version.
+// Later reads of the same content open the crate instead (memory-mapped, and loaded lazily by Sdf)
+// rather than parsing and meshing the voxels again.
+//
+// The file name is only a 64-bit hash, so each crate also records, in its customLayerData, the source's size, a
+// second hash of it and the arguments it was converted with; a crate that doesn't match is treated as a miss.
+class UsdVoxelConversionCache {
+    std::string path;
+    std::string verificationPrefix;     // the verification string, without the contents' check hash
+    VoxelContentHashes *contents = nullptr;
+
+    // The contents are only hashed a second time when there's a crate to check, or one to write.
+    std::string verification() const;
+
+public:
+    // extraKey is anything else the converted layer depends on, e.g. the file's name when the layer refers back to
+    // it by name (payloads=1).
+    // contents must outlive the cache object.
+    UsdVoxelConversionCache(const pxr::TfToken &formatId, const pxr::TfToken &formatVersion,
+                            VoxelContentHashes &contents,
+                            const pxr::SdfFileFormat::FileFormatArguments &args,
+                            const std::string &extraKey = std::string());
+
+    bool isEnabled() const {
+        return !path.empty();
+    }
+
+    // True if USDVOXEL_CACHE_DIR is set, without having to hash any contents.
+    static bool isConfigured();
+
+    // Loads the cached crate into the layer. Returns false on a cache miss, or if the crate was converted from
+    // something else.
+    bool read(pxr::SdfLayer *layer, bool metadataOnly) const;
+
+    // Saves a freshly converted layer to the cache, recording what it was converted from in its customLayerData.
+    // The crate is written under a temporary name and renamed into place,
+    // so concurrent readers on other machines never see a partial file.
+    void write(pxr::SdfLayer &layer) const;
+};
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef __CONVERTER_REVISION_H__
+#define __CONVERTER_REVISION_H__
+
+#include <stdint.h>
+
+// Bump this whenever the converter's output changes for the same input and arguments,
+// so stale conversions (cached crates, usdVoxelConvert outputs) are never read back.
+static const uint64_t k_converter_revision = 4;
+
+#endif
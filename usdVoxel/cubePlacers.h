@@ -11,25 +11,111 @@
 #include "pxr/usd/sdf/relationshipSpec.h"
 #include "pxr/usd/sdf/types.h"
 
+#include "pooledArray.h"
+
 #include <stdio.h>
 
-class SdfMeshCubePlacer {
+// Bits of the `sides` mask passed to place(), one per cube face that should be emitted.
+// This matches the backface culling bits of a KVX slab, after KVX's axes are reoriented.
+static const uint8_t k_cube_side_left   = 1 << 0;   // -x
+static const uint8_t k_cube_side_right  = 1 << 1;   // +x
+static const uint8_t k_cube_side_back   = 1 << 2;   // -z
+static const uint8_t k_cube_side_front  = 1 << 3;   // +z
+static const uint8_t k_cube_side_top    = 1 << 4;   // +y
+static const uint8_t k_cube_side_bottom = 1 << 5;   // -y
+static const uint8_t k_cube_side_all    = 0x3f;
+
+// The corners of each side of a cube, in the order of the bits above, as its faces are wound.
+// Corner i is at the low (0) or high (1) end of x, y and z by bits 0, 1 and 2 of i.
+static const int k_cube_side_corners[6][4] = {
+    {0,4,6,2},  // left
+    {5,1,3,7},  // right
+    {1,0,2,3},  // back
+    {4,5,7,6},  // front
+    {6,7,3,2},  // top
+    {0,1,5,4}   // bottom
+};
+
+// The arrays authored on a Mesh prim by SdfMeshCubePlacer.
+// VtArrays are copy-on-write, so copies of this struct share their buffers.
+struct SdfMeshArrays {
     pxr::VtVec3fArray points;
     pxr::VtIntArray faceVertexIndices;
     pxr::VtIntArray faceVertexCounts;
     pxr::VtVec3fArray displayColor;
     pxr::VtVec3fArray normals;
 
+    size_t memoryUsage() const {
+        return points.size() * sizeof(pxr::GfVec3f)
+            + faceVertexIndices.size() * sizeof(int)
+            + faceVertexCounts.size() * sizeof(int)
+            + displayColor.size() * sizeof(pxr::GfVec3f)
+            + normals.size() * sizeof(pxr::GfVec3f);
+    }
+
+    pxr::SdfPrimSpecHandle writePrim(pxr::SdfLayerHandle layer, pxr::SdfPath path) const {
+        using namespace pxr;
+
+        auto primspec = SdfCreatePrimInLayer(layer, path);
+        primspec->SetSpecifier(SdfSpecifierDef);
+        primspec->SetTypeName("Mesh");
+
+        auto subd_attr = SdfAttributeSpec::New(primspec, "subdivisionScheme", SdfValueTypeNames->Token);
+        subd_attr->SetDefaultValue(VtValue(TfToken("none")));
+        auto normals_attr = SdfAttributeSpec::New(primspec, "normals", SdfValueTypeNames->Normal3fArray);
+        normals_attr->SetDefaultValue(VtValue(normals));
+        normals_attr->SetField(TfToken("interpolation"), TfToken("uniform"));
+
+        auto fvi_attr = SdfAttributeSpec::New(primspec, "faceVertexIndices", SdfValueTypeNames->IntArray);
+        auto fvc_attr = SdfAttributeSpec::New(primspec, "faceVertexCounts", SdfValueTypeNames->IntArray);
+        auto points_attr = SdfAttributeSpec::New(primspec, "points", SdfValueTypeNames->Vector3fArray);
+        auto displayColor_attr = SdfAttributeSpec::New(primspec, "primvars:displayColor", SdfValueTypeNames->Color3fArray);
+        displayColor_attr->SetField(TfToken("interpolation"), TfToken("uniform"));
+
+        fvi_attr->SetDefaultValue(VtValue(faceVertexIndices));
+        fvc_attr->SetDefaultValue(VtValue(faceVertexCounts));
+        points_attr->SetDefaultValue(VtValue(points));
+        displayColor_attr->SetDefaultValue(VtValue(displayColor));
+
+        return primspec;
+    }
+};
+
+class SdfMeshCubePlacer {
+    // Meshing writes straight into pooled buffers, which become the VtArrays without a copy.
+    VoxelPooledBuffer<pxr::GfVec3f> *points;
+    VoxelPooledBuffer<int> *faceVertexIndices;
+    VoxelPooledBuffer<int> *faceVertexCounts;
+    VoxelPooledBuffer<pxr::GfVec3f> *displayColor;
+    VoxelPooledBuffer<pxr::GfVec3f> *normals;
+
     int currentLevel;
     float xcentroid, ycentroid, zcentroid;
 
+    void acquireBuffers() {
+        points = VoxelBufferPool<pxr::GfVec3f>::acquire();
+        faceVertexIndices = VoxelBufferPool<int>::acquire();
+        faceVertexCounts = VoxelBufferPool<int>::acquire();
+        displayColor = VoxelBufferPool<pxr::GfVec3f>::acquire();
+        normals = VoxelBufferPool<pxr::GfVec3f>::acquire();
+    }
+
 public:
     SdfMeshCubePlacer()
         : currentLevel(0),
           xcentroid(0), ycentroid(0), zcentroid(0)
     {
-
+        acquireBuffers();
+    }
+    ~SdfMeshCubePlacer() {
+        VoxelBufferPool<pxr::GfVec3f>::release(points);
+        VoxelBufferPool<int>::release(faceVertexIndices);
+        VoxelBufferPool<int>::release(faceVertexCounts);
+        VoxelBufferPool<pxr::GfVec3f>::release(displayColor);
+        VoxelBufferPool<pxr::GfVec3f>::release(normals);
     }
+    SdfMeshCubePlacer(const SdfMeshCubePlacer &) = delete;
+    SdfMeshCubePlacer &operator=(const SdfMeshCubePlacer &) = delete;
     void setLevel(int level) {
         this->currentLevel = level;
     }
@@ -86,20 +172,23 @@ public:
             GfVec3f(x2,y2,z2),
         };
 
-        size_t offset = points.size();
-
-        for (auto vert: verts) {
-            points.push_back(vert);
+        // only the corners of the sides being emitted, so culled faces leave no unreferenced points behind
+        int cornerIndices[8];
+        uint8_t usedCorners = 0;
+        for (int j = 0; j < 6; j++) {
+            if (sides & (1<<j)) {
+                for (int i = 0; i < 4; i++) {
+                    usedCorners |= 1 << k_cube_side_corners[j][i];
+                }
+            }
+        }
+        for (int c = 0; c < 8; c++) {
+            if (usedCorners & (1<<c)) {
+                cornerIndices[c] = (int)points->storage.size();
+                points->storage.push_back(verts[c]);
+            }
         }
 
-        static const int indices[][4] = {
-            {0,4,6,2},  // left
-            {5,1,3,7},  // right
-            {1,0,2,3},  // back
-            {4,5,7,6},  // front
-            {6,7,3,2},  // top
-            {0,1,5,4}   // bottom
-        };
         static const GfVec3f sideNormals[] = {
             GfVec3f(-1,0,0),
             GfVec3f(1,0,0),
@@ -115,38 +204,37 @@ public:
                 continue;
             }
             for (int i = 0; i < 4; i++) {
-                faceVertexIndices.push_back(offset + indices[j][i]);
+                faceVertexIndices->storage.push_back(cornerIndices[k_cube_side_corners[j][i]]);
             }
-            faceVertexCounts.push_back(4);
-            displayColor.push_back(GfVec3f(r, g, b));
-            normals.push_back(sideNormals[j]);
+            faceVertexCounts->storage.push_back(4);
+            displayColor->storage.push_back(GfVec3f(r, g, b));
+            normals->storage.push_back(sideNormals[j]);
+        }
+    }
+    // Appends a mesh built by another placer, as if its cubes had been placed here.
+    void append(const SdfMeshArrays &arrays) {
+        int offset = (int)points->storage.size();
+        points->storage.insert(points->storage.end(), arrays.points.cbegin(), arrays.points.cend());
+        for (int index : arrays.faceVertexIndices) {
+            faceVertexIndices->storage.push_back(offset + index);
         }
+        faceVertexCounts->storage.insert(faceVertexCounts->storage.end(), arrays.faceVertexCounts.cbegin(), arrays.faceVertexCounts.cend());
+        displayColor->storage.insert(displayColor->storage.end(), arrays.displayColor.cbegin(), arrays.displayColor.cend());
+        normals->storage.insert(normals->storage.end(), arrays.normals.cbegin(), arrays.normals.cend());
+    }
+    // Hands the meshed buffers over to VtArrays, and starts over with empty buffers.
+    SdfMeshArrays takeArrays() {
+        SdfMeshArrays arrays;
+        arrays.points = points->toVtArray();
+        arrays.faceVertexIndices = faceVertexIndices->toVtArray();
+        arrays.faceVertexCounts = faceVertexCounts->toVtArray();
+        arrays.displayColor = displayColor->toVtArray();
+        arrays.normals = normals->toVtArray();
+        acquireBuffers();
+        return arrays;
     }
     pxr::SdfPrimSpecHandle writePrim(pxr::SdfLayerHandle layer, pxr::SdfPath path) {
-        using namespace pxr;
-
-        auto primspec = SdfCreatePrimInLayer(layer, path);
-        primspec->SetSpecifier(SdfSpecifierDef);
-        primspec->SetTypeName("Mesh");
-
-        auto subd_attr = SdfAttributeSpec::New(primspec, "subdivisionScheme", SdfValueTypeNames->Token);
-        subd_attr->SetDefaultValue(VtValue(TfToken("none")));
-        auto normals_attr = SdfAttributeSpec::New(primspec, "normals", SdfValueTypeNames->Normal3fArray);
-        normals_attr->SetDefaultValue(VtValue(normals));
-        normals_attr->SetField(TfToken("interpolation"), TfToken("uniform"));
-
-        auto fvi_attr = SdfAttributeSpec::New(primspec, "faceVertexIndices", SdfValueTypeNames->IntArray);
-        auto fvc_attr = SdfAttributeSpec::New(primspec, "faceVertexCounts", SdfValueTypeNames->IntArray);
-        auto points_attr = SdfAttributeSpec::New(primspec, "points", SdfValueTypeNames->Vector3fArray);
-        auto displayColor_attr = SdfAttributeSpec::New(primspec, "primvars:displayColor", SdfValueTypeNames->Color3fArray);
-        displayColor_attr->SetField(TfToken("interpolation"), TfToken("uniform"));
-
-        fvi_attr->SetDefaultValue(VtValue(faceVertexIndices));
-        fvc_attr->SetDefaultValue(VtValue(faceVertexCounts));
-        points_attr->SetDefaultValue(VtValue(points));
-        displayColor_attr->SetDefaultValue(VtValue(displayColor));
-
-        return primspec;
+        return takeArrays().writePrim(layer, path);
     }
 };
 
@@ -217,4 +305,57 @@ public:
     }
 };
 
+// One point per voxel, for voxels seen from far enough away that a round point stands in for a cube.
+class SdfPointsCubePlacer {
+    pxr::VtVec3fArray points;
+    pxr::VtVec3fArray displayColor;
+
+    int currentLevel;
+    float xcentroid, ycentroid, zcentroid;
+
+public:
+    SdfPointsCubePlacer()
+        : currentLevel(0),
+          xcentroid(0), ycentroid(0), zcentroid(0)
+    {
+
+    }
+    void setLevel(int level) {
+        this->currentLevel = level;
+    }
+    void setCentroid(float x, float y, float z) {
+        this->xcentroid = x;
+        this->ycentroid = y;
+        this->zcentroid = z;
+    }
+    void place(int32_t ix, int32_t iy, int32_t iz, float r, float g, float b, uint8_t _sides) {
+        using namespace pxr;
+
+        if (currentLevel != 0) {
+            return;
+        }
+        points.push_back(GfVec3f(ix - this->xcentroid, iy - this->ycentroid, iz - this->zcentroid));
+        displayColor.push_back(GfVec3f(r, g, b));
+    }
+    pxr::SdfPrimSpecHandle writePrim(pxr::SdfLayerHandle layer, pxr::SdfPath path) {
+        using namespace pxr;
+
+        auto primspec = SdfCreatePrimInLayer(layer, path);
+        primspec->SetSpecifier(SdfSpecifierDef);
+        primspec->SetTypeName("Points");
+
+        auto points_attr = SdfAttributeSpec::New(primspec, "points", SdfValueTypeNames->Point3fArray);
+        auto widths_attr = SdfAttributeSpec::New(primspec, "widths", SdfValueTypeNames->FloatArray);
+        widths_attr->SetField(TfToken("interpolation"), TfToken("constant"));
+        auto displayColor_attr = SdfAttributeSpec::New(primspec, "primvars:displayColor", SdfValueTypeNames->Color3fArray);
+        displayColor_attr->SetField(TfToken("interpolation"), TfToken("vertex"));
+
+        points_attr->SetDefaultValue(VtValue(points));
+        widths_attr->SetDefaultValue(VtValue(VtFloatArray({ 1.0f })));
+        displayColor_attr->SetDefaultValue(VtValue(displayColor));
+
+        return primspec;
+    }
+};
+
 #endif
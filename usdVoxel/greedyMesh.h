@@ -0,0 +1,163 @@
+#ifndef __GREEDY_MESH_H__
+#define __GREEDY_MESH_H__
+
+#include "cubePlacers.h"
+
+#include "pxr/base/gf/vec3f.h"
+#include "pxr/base/vt/types.h"
+
+#include <algorithm>
+#include <map>
+#include <math.h>
+#include <stdint.h>
+#include <tuple>
+#include <vector>
+
+// The center of the cube a face of a cube mesh belongs to, which is half a voxel behind the center of the face.
+static pxr::GfVec3f VoxelFaceCubeCenter(const SdfMeshArrays &arrays, size_t face, size_t start) {
+    using namespace pxr;
+    int count = arrays.faceVertexCounts[face];
+    float center[3] = { 0, 0, 0 };
+    for (int i = 0; i < count; i++) {
+        const GfVec3f &p = arrays.points[arrays.faceVertexIndices[start + i]];
+        for (int axis = 0; axis < 3; axis++) {
+            center[axis] += p[axis];
+        }
+    }
+    GfVec3f result;
+    for (int axis = 0; axis < 3; axis++) {
+        result[axis] = center[axis] / count - 0.5f * arrays.normals[face][axis];
+    }
+    return result;
+}
+
+// The cube side (as an index into k_cube_side_corners) a face normal points out of.
+static int VoxelNormalSide(const pxr::GfVec3f &normal) {
+    if (normal[0] < -0.5f) return 0;
+    if (normal[0] > 0.5f) return 1;
+    if (normal[2] < -0.5f) return 2;
+    if (normal[2] > 0.5f) return 3;
+    if (normal[1] > 0.5f) return 4;
+    return 5;
+}
+
+// Merges the faces of a cube mesh (as built by SdfMeshCubePlacer) that lie side by side in the same plane, facing
+// the same way and with the same color, into as few rectangles as a greedy sweep finds. Each rectangle keeps the
+// normal and winding of the faces it replaces. Rectangles can meet others mid-edge (T-junctions), which renderers
+// handle well enough for axis-aligned quads, but may show as hairline cracks under displacement.
+static SdfMeshArrays VoxelGreedyMesh(const SdfMeshArrays &cubes) {
+    using namespace pxr;
+
+    const size_t numFaces = cubes.faceVertexCounts.size();
+    if (numFaces == 0) {
+        return cubes;
+    }
+
+    // Cube centers are on a grid, but not necessarily an integer one (e.g. a .kvx's pivot), so they're
+    // measured from the first cube.
+    GfVec3f origin = VoxelFaceCubeCenter(cubes, 0, 0);
+
+    // faces by side, plane and color; each cell is (v, u), the face's cube on the plane's two other axes
+    typedef std::tuple<int, int32_t, uint32_t> PlaneKey;
+    std::map<PlaneKey, std::vector<std::pair<int32_t, int32_t>>> planes;
+    std::map<std::tuple<float, float, float>, uint32_t> colorIndices;
+    std::vector<GfVec3f> colors;
+    size_t start = 0;
+    for (size_t f = 0; f < numFaces; f++) {
+        GfVec3f center = VoxelFaceCubeCenter(cubes, f, start);
+        start += cubes.faceVertexCounts[f];
+        int32_t cell[3];
+        for (int axis = 0; axis < 3; axis++) {
+            cell[axis] = (int32_t)lroundf(center[axis] - origin[axis]);
+        }
+        int side = VoxelNormalSide(cubes.normals[f]);
+        int axis = side < 2 ? 0 : side < 4 ? 2 : 1;
+        const GfVec3f &color = cubes.displayColor[f];
+        auto inserted = colorIndices.emplace(std::make_tuple(color[0], color[1], color[2]), (uint32_t)colors.size());
+        if (inserted.second) {
+            colors.push_back(color);
+        }
+        planes[PlaneKey(side, cell[axis], inserted.first->second)].emplace_back(cell[(axis + 2) % 3], cell[(axis + 1) % 3]);
+    }
+
+    std::vector<GfVec3f> points;
+    std::vector<int> faceVertexIndices, faceVertexCounts;
+    std::vector<GfVec3f> displayColor, normals;
+    for (auto &entry : planes) {
+        int side = std::get<0>(entry.first);
+        int axis = side < 2 ? 0 : side < 4 ? 2 : 1;
+        int uAxis = (axis + 1) % 3, vAxis = (axis + 2) % 3;
+        std::vector<std::pair<int32_t, int32_t>> &cells = entry.second;
+        std::sort(cells.begin(), cells.end());
+        cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+        std::vector<bool> used(cells.size(), false);
+        auto available = [&](int32_t v, int32_t u) {
+            auto it = std::lower_bound(cells.begin(), cells.end(), std::make_pair(v, u));
+            return it != cells.end() && *it == std::make_pair(v, u) && !used[it - cells.begin()];
+        };
+        auto take = [&](int32_t v, int32_t u) {
+            used[std::lower_bound(cells.begin(), cells.end(), std::make_pair(v, u)) - cells.begin()] = true;
+        };
+
+        for (size_t i = 0; i < cells.size(); i++) {
+            if (used[i]) {
+                continue;
+            }
+            int32_t v0 = cells[i].first, u0 = cells[i].second;
+            // as wide as the row allows, then as tall as whole rows of that width allow
+            int32_t u1 = u0;
+            while (available(v0, u1 + 1)) {
+                u1++;
+            }
+            int32_t v1 = v0;
+            for (;;) {
+                bool fullRow = true;
+                for (int32_t u = u0; u <= u1 && fullRow; u++) {
+                    fullRow = available(v1 + 1, u);
+                }
+                if (!fullRow) {
+                    break;
+                }
+                v1++;
+            }
+            for (int32_t v = v0; v <= v1; v++) {
+                for (int32_t u = u0; u <= u1; u++) {
+                    take(v, u);
+                }
+            }
+
+            // the corners of the rectangle are those of the cube side it replaces, stretched over its cells
+            float low[3], high[3];
+            low[axis] = high[axis] = (float)std::get<1>(entry.first);
+            low[uAxis] = (float)u0;
+            high[uAxis] = (float)u1;
+            low[vAxis] = (float)v0;
+            high[vAxis] = (float)v1;
+            int offset = (int)points.size();
+            for (int c = 0; c < 4; c++) {
+                int corner = k_cube_side_corners[side][c];
+                GfVec3f p;
+                for (int a = 0; a < 3; a++) {
+                    p[a] = origin[a] + ((corner >> a) & 1 ? high[a] + 0.5f : low[a] - 0.5f);
+                }
+                points.push_back(p);
+                faceVertexIndices.push_back(offset + c);
+            }
+            faceVertexCounts.push_back(4);
+            displayColor.push_back(colors[std::get<2>(entry.first)]);
+            GfVec3f normal(0, 0, 0);
+            normal[axis] = (side == 1 || side == 3 || side == 4) ? 1.0f : -1.0f;
+            normals.push_back(normal);
+        }
+    }
+
+    SdfMeshArrays merged;
+    merged.points.assign(points.begin(), points.end());
+    merged.faceVertexIndices.assign(faceVertexIndices.begin(), faceVertexIndices.end());
+    merged.faceVertexCounts.assign(faceVertexCounts.begin(), faceVertexCounts.end());
+    merged.displayColor.assign(displayColor.begin(), displayColor.end());
+    merged.normals.assign(normals.begin(), normals.end());
+    return merged;
+}
+
+#endif
@@ -3,11 +3,36 @@
 #ifndef __KVX_H__
 #define __KVX_H__
 
+#include <algorithm>
 #include <stdint.h>
 #include <stdlib.h>
 
-template <class T> 
-static bool KvxRead(const unsigned char *contents, size_t contents_size, T &cubePlacer) {
+// One level of detail in a KVX file. Pointers refer into the file contents.
+struct KvxLevel {
+    uint32_t xsiz, ysiz, zsiz;
+    uint32_t xpivot, ypivot, zpivot;
+    const uint8_t *xoffset;     // xsiz+1 little-endian uint32s
+    const uint8_t *xyoffset;    // xsiz*(ysiz+1) little-endian uint16s
+    const uint8_t *voxdata;
+    size_t voxdata_size;
+};
+
+struct KvxFile {
+    const uint8_t *palette;
+    int num_levels;
+    KvxLevel levels[5];
+};
+
+static inline uint32_t KvxReadU32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t KvxReadU16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+// Reads the palette and the level headers, without touching the voxel data.
+static bool KvxParse(const unsigned char *contents, size_t contents_size, KvxFile &file) {
 #define ERROR(message) return false
 
     if (contents_size < 768) {
@@ -17,17 +42,19 @@ static bool KvxRead(const unsigned char *contents, size_t contents_size, T &cube
 
     size_t read_offset = 0;
 
-    // It's expected to run out of room in the file - it means there are no levels left. So we just exit successfully.
+    // It's expected to run out of room in the file - it means there are no levels left. So we just stop there.
+    // Sizes are computed in 64 bits, so huge (or bogus) dimensions can't wrap around and pass the check.
 #define READ_BUF(var, size, type) \
-    if (read_offset + (size) * sizeof(type) > contents_size) { return true; } \
-    const type *var = (type*)(contents + read_offset); \
+    if ((uint64_t)(size) * sizeof(type) > contents_size - read_offset) { return true; } \
+    const uint8_t *var = contents + read_offset; \
     read_offset += (size) * sizeof(type)
 
-#define READ_U32(var) uint32_t var; { READ_BUF(buf, 4, uint8_t); var = buf[0] | (buf[1] << 8) | (buf[2] << 16) | (buf[3]<<24); }
+#define READ_U32(var) uint32_t var; { READ_BUF(buf, 4, uint8_t); var = KvxReadU32(buf); }
 
     // it's easier to read the palette first
     // this is always at the end of the file
-    const uint8_t *palette = contents + contents_size - 768;
+    file.palette = contents + contents_size - 768;
+    file.num_levels = 0;
     // shrink the perceived size of the contents
     contents_size -= 768;
 
@@ -41,72 +68,184 @@ static bool KvxRead(const unsigned char *contents, size_t contents_size, T &cube
         READ_U32(ypivot);
         READ_U32(zpivot);
 
-        READ_BUF(xoffset, xsiz+1, uint32_t);
-        READ_BUF(xyoffset, xsiz * (ysiz+1), uint16_t);
+        READ_BUF(xoffset, (uint64_t)xsiz+1, uint32_t);
+        READ_BUF(xyoffset, (uint64_t)xsiz * ((uint64_t)ysiz+1), uint16_t);
 
         // header size, excluding numbytes (so: xsiz, ysiz, zsiz, xpivot, ypivot, zpivot)
-        uint32_t header_size = 24 + (xsiz+1)*4 + xsiz*(ysiz+1)*2;
+        uint64_t header_size = 24 + ((uint64_t)xsiz+1)*4 + (uint64_t)xsiz*((uint64_t)ysiz+1)*2;
         if (numbytes < header_size) {
             ERROR("numbytes is smaller than header");
         }
-        uint32_t voxdata_size = numbytes - header_size;
+        uint32_t voxdata_size = numbytes - (uint32_t)header_size;
 
         READ_BUF(voxdata, voxdata_size, uint8_t);
 
-        cubePlacer.setLevel(level);
-        // KVX is opinionated with X=right, Y=front, and Z=down.
-        // Reorient to: X=right, Y=up, Z=front
-        // (x,y,z) = (x,-z,y)
-        cubePlacer.setCentroid((float)xpivot / 256.0f, -(float)zpivot / 256.0f, (float)ypivot / 256.0f);
+        file.levels[level] = { xsiz, ysiz, zsiz, xpivot, ypivot, zpivot, xoffset, xyoffset, voxdata, voxdata_size };
+        file.num_levels = level + 1;
+    }
 
-        size_t off = 0;
+#undef READ_U32
+#undef READ_BUF
+#undef ERROR
 
-        for (int32_t x = 0; x < xsiz; x++) {
-            for (int32_t y = 0; y < ysiz; y++) {
-                size_t start = xoffset[x] + xyoffset[x*(ysiz+1) + y];
-                size_t end   = xoffset[x] + xyoffset[x*(ysiz+1) + y + 1];
+    return true;
+}
 
-                int32_t n = end - start;
+// A box of voxels in a level's own axes (X=right, Y=front, Z=down), bounds included.
+struct KvxBox {
+    int32_t lo[3], hi[3];
+};
 
-                while (n > 0) {
-                    const uint8_t *startptr = voxdata + off;
+// Narrows [begin, end) to the voxels from lo to hi.
+static inline void KvxClampRange(int32_t lo, int32_t hi, uint32_t *begin, uint32_t *end) {
+    if (lo > 0 && (uint32_t)lo > *begin) {
+        *begin = (uint32_t)lo;
+    }
+    uint32_t last = hi < 0 ? 0 : (uint32_t)hi + 1;
+    if (last < *end) {
+        *end = last;
+    }
+    if (*begin > *end) {
+        *begin = *end;
+    }
+}
 
-                    uint8_t slabztop = startptr[0];
-                    uint8_t slabzleng = startptr[1];
+// Places the voxels of columns [x0, x1) of a level. Columns are independent, so separate x ranges
+// can be meshed concurrently, into separate placers.
+// With a box, only the voxels inside it are placed, and the columns outside it are never read. Voxels on
+// the box's sides get faces there, so the cut is closed wherever the slabs have voxels.
+// If placed is given, the number of voxels placed is added to it.
+template <class T>
+static bool KvxReadColumns(const KvxFile &file, int level, uint32_t x0, uint32_t x1, T &cubePlacer, const KvxBox *box = nullptr,
+                           size_t *placed = nullptr) {
+    const KvxLevel &lvl = file.levels[level];
+    const uint8_t *palette = file.palette;
+    const size_t ysiz = lvl.ysiz;
+    uint32_t y0 = 0, y1 = lvl.ysiz;
+    if (box) {
+        KvxClampRange(box->lo[0], box->hi[0], &x0, &x1);
+        KvxClampRange(box->lo[1], box->hi[1], &y0, &y1);
+    }
 
-                    // unused for now
-                    uint8_t slabbackfacecullinfo = startptr[2];
+    cubePlacer.setLevel(level);
+    // KVX is opinionated with X=right, Y=front, and Z=down.
+    // Reorient to: X=right, Y=up, Z=front
+    // (x,y,z) = (x,-z,y)
+    cubePlacer.setCentroid((float)lvl.xpivot / 256.0f, -(float)lvl.zpivot / 256.0f, (float)lvl.ypivot / 256.0f);
+
+    // xoffset counts from the start of the xoffset table itself, so rebase it onto voxdata
+    const uint32_t base = KvxReadU32(lvl.xoffset);
+
+    for (uint32_t x = x0; x < x1 && x < lvl.xsiz; x++) {
+        size_t column = (size_t)(KvxReadU32(lvl.xoffset + (size_t)x*4) - base);
+        const uint8_t *columnOffsets = lvl.xyoffset + (size_t)x*(ysiz+1)*2;
+        for (size_t y = y0; y < y1; y++) {
+            size_t start = column + KvxReadU16(columnOffsets + y*2);
+            size_t end   = column + KvxReadU16(columnOffsets + (y+1)*2);
+            if (end > lvl.voxdata_size) {
+                return false;
+            }
 
-                    for (int32_t i = 0; i < slabzleng; i++) {
-                        int32_t z = slabztop + i;
-                        uint8_t val = startptr[3 + i];
+            size_t off = start;
+            while (off + 3 <= end) {
+                const uint8_t *startptr = lvl.voxdata + off;
 
-                        uint8_t r = palette[val*3 + 0];
-                        uint8_t g = palette[val*3 + 1];
-                        uint8_t b = palette[val*3 + 2];
+                uint8_t slabztop = startptr[0];
+                uint8_t slabzleng = startptr[1];
+                uint8_t slabbackfacecullinfo = startptr[2];
 
-                        float fr = (float)r / 63.0f;
-                        float fg = (float)g / 63.0f;
-                        float fb = (float)b / 63.0f;
+                if (off + 3 + slabzleng > end) {
+                    return false;
+                }
 
-                        // KVX is opinionated with X=right, Y=front, and Z=down.
-                        // Reorient to: X=right, Y=up, Z=front
-                        // (x,y,z) = (x,-z,y)
-                        cubePlacer.place(x, -z, y, fr, fg, fb, slabbackfacecullinfo);
+                for (int32_t i = 0; i < slabzleng; i++) {
+                    int32_t z = slabztop + i;
+                    uint8_t val = startptr[3 + i];
+                    uint8_t sides = slabbackfacecullinfo;
+                    if (box) {
+                        if (z < box->lo[2] || z > box->hi[2]) {
+                            continue;
+                        }
+                        // the same bits as the culling info: -x, +x, -y, +y, -z, +z
+                        if ((int32_t)x == box->lo[0]) sides |= 1 << 0;
+                        if ((int32_t)x == box->hi[0]) sides |= 1 << 1;
+                        if ((int32_t)y == box->lo[1]) sides |= 1 << 2;
+                        if ((int32_t)y == box->hi[1]) sides |= 1 << 3;
+                        if (z == box->lo[2]) sides |= 1 << 4;
+                        if (z == box->hi[2]) sides |= 1 << 5;
                     }
 
-                    n -= slabzleng + 3;
-                    off += slabzleng + 3;
+                    uint8_t r = palette[val*3 + 0];
+                    uint8_t g = palette[val*3 + 1];
+                    uint8_t b = palette[val*3 + 2];
+
+                    float fr = (float)r / 63.0f;
+                    float fg = (float)g / 63.0f;
+                    float fb = (float)b / 63.0f;
+
+                    // KVX is opinionated with X=right, Y=front, and Z=down.
+                    // Reorient to: X=right, Y=up, Z=front
+                    // (x,y,z) = (x,-z,y)
+                    cubePlacer.place(x, -z, y, fr, fg, fb, sides);
+                    if (placed) {
+                        (*placed)++;
+                    }
                 }
 
+                off += slabzleng + 3;
             }
         }
     }
+    return true;
+}
 
-#undef READ_U32
-#undef READ_BUF
-#undef ERROR
+// The number of voxels a level stores. Slabs only hold the voxels that can be seen, so this is its surface, not
+// its solid voxel count. With a box, only those KvxReadColumns would place. Returns 0 if the level's offsets are
+// out of bounds.
+static size_t KvxCountVoxels(const KvxLevel &lvl, const KvxBox *box = nullptr) {
+    const uint32_t base = KvxReadU32(lvl.xoffset);
+    uint32_t x0 = 0, x1 = lvl.xsiz, y0 = 0, y1 = lvl.ysiz;
+    if (box) {
+        KvxClampRange(box->lo[0], box->hi[0], &x0, &x1);
+        KvxClampRange(box->lo[1], box->hi[1], &y0, &y1);
+    }
+    size_t count = 0;
+    for (uint32_t x = x0; x < x1; x++) {
+        size_t column = (size_t)(KvxReadU32(lvl.xoffset + (size_t)x*4) - base);
+        const uint8_t *columnOffsets = lvl.xyoffset + (size_t)x*((size_t)lvl.ysiz+1)*2;
+        for (size_t y = y0; y < y1; y++) {
+            size_t off = column + KvxReadU16(columnOffsets + y*2);
+            size_t end = column + KvxReadU16(columnOffsets + (y+1)*2);
+            if (end > lvl.voxdata_size) {
+                return 0;
+            }
+            while (off + 3 <= end) {
+                int32_t ztop = lvl.voxdata[off], zleng = lvl.voxdata[off + 1];
+                if (box) {
+                    // the slab's voxels from box->lo[2] to box->hi[2], as KvxReadColumns places them
+                    int32_t z0 = std::max(ztop, box->lo[2]), z1 = std::min(ztop + zleng - 1, box->hi[2]);
+                    count += z1 >= z0 ? (size_t)(z1 - z0 + 1) : 0;
+                } else {
+                    count += zleng;
+                }
+                off += zleng + 3;
+            }
+        }
+    }
+    return count;
+}
 
+template <class T>
+static bool KvxRead(const unsigned char *contents, size_t contents_size, T &cubePlacer) {
+    KvxFile file;
+    if (!KvxParse(contents, contents_size, file)) {
+        return false;
+    }
+    for (int level = 0; level < file.num_levels; level++) {
+        if (!KvxReadColumns(file, level, 0, file.levels[level].xsiz, cubePlacer)) {
+            return false;
+        }
+    }
     return true;
 }
 
@@ -0,0 +1,72 @@
+#include "meshCache.h"
+
+#include "pxr/base/tf/envSetting.h"
+
+using namespace pxr;
+
+TF_DEFINE_ENV_SETTING(USDVOXEL_MESH_CACHE_MB, 512,
+                      "Memory budget in megabytes for meshed voxel models shared across layers. "
+                      "Set to 0 to disable the cache.");
+
+UsdVoxelMeshCache::UsdVoxelMeshCache()
+    : memoryUsage(0),
+      memoryBudget((size_t)TfGetEnvSetting(USDVOXEL_MESH_CACHE_MB) * 1024 * 1024)
+{
+
+}
+
+UsdVoxelMeshCache &UsdVoxelMeshCache::get() {
+    static UsdVoxelMeshCache cache;
+    return cache;
+}
+
+bool UsdVoxelMeshCache::find(uint64_t key, const std::function<UsdVoxelMeshCheck()> &check, SdfMeshArrays *arrays) {
+    UsdVoxelMeshCheck stored;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            return false;
+        }
+        stored = it->second->check;
+    }
+
+    // outside the lock: the check may hash a whole file
+    if (!(check() == stored)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it == index.end() || !(it->second->check == stored)) {
+        // evicted meanwhile
+        return false;
+    }
+    entries.splice(entries.begin(), entries, it->second);
+    *arrays = it->second->arrays;
+    return true;
+}
+
+void UsdVoxelMeshCache::insert(uint64_t key, const UsdVoxelMeshCheck &check, const SdfMeshArrays &arrays) {
+    size_t size = arrays.memoryUsage();
+    if (size > memoryBudget) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (index.find(key) != index.end()) {
+        // another layer meshed the same model concurrently (or, if the checks differ, a different one whose key
+        // collides; that one keeps the entry)
+        return;
+    }
+    entries.push_front(Entry{ key, check, arrays });
+    index.emplace(key, entries.begin());
+    memoryUsage += size;
+
+    while (memoryUsage > memoryBudget && !entries.empty()) {
+        auto &last = entries.back();
+        memoryUsage -= last.arrays.memoryUsage();
+        index.erase(last.key);
+        entries.pop_back();
+    }
+}
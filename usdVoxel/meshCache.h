@@ -0,0 +1,58 @@
+#ifndef __MESH_CACHE_H__
+#define __MESH_CACHE_H__
+
+#include "cubePlacers.h"
+
+#include <functional>
+#include <list>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+
+// A process-wide cache of meshed models, shared by every layer the plugin reads.
+//
+// Entries are keyed by a hash of the model's voxel content combined with everything else that affects the
+// meshing result (palette, meshing options). A hit hands back VtArrays that share their buffers with every
+// other layer holding the same mesh, through Vt's copy-on-write.
+//
+// Keys are only 64-bit hashes, so each entry also keeps a UsdVoxelMeshCheck of what it was meshed from, and a hit
+// whose check differs is a miss. The check is only computed when the key is found.
+//
+// The cache is bounded by USDVOXEL_MESH_CACHE_MB and evicts the least recently used meshes first.
+// Evicting only drops the cache's reference; layers keep the arrays they already hold.
+struct UsdVoxelMeshCheck {
+    uint32_t dims[3] = { 0, 0, 0 };
+    uint64_t voxels = 0;    // number of voxels
+    uint64_t hash = 0;      // VoxelHash64Check of the same content and options as the key
+
+    bool operator==(const UsdVoxelMeshCheck &other) const {
+        return dims[0] == other.dims[0] && dims[1] == other.dims[1] && dims[2] == other.dims[2] &&
+               voxels == other.voxels && hash == other.hash;
+    }
+};
+
+class UsdVoxelMeshCache {
+    struct Entry {
+        uint64_t key;
+        UsdVoxelMeshCheck check;
+        SdfMeshArrays arrays;
+    };
+    typedef std::list<Entry> EntryList;
+
+    std::mutex mutex;
+    EntryList entries;  // most recently used first
+    std::unordered_map<uint64_t, EntryList::iterator> index;
+    size_t memoryUsage;
+    size_t memoryBudget;
+
+    UsdVoxelMeshCache();
+
+public:
+    static UsdVoxelMeshCache &get();
+
+    bool find(uint64_t key, const std::function<UsdVoxelMeshCheck()> &check, SdfMeshArrays *arrays);
+    void insert(uint64_t key, const UsdVoxelMeshCheck &check, const SdfMeshArrays &arrays);
+};
+
+#endif
@@ -0,0 +1,407 @@
+#ifndef __MESH_CHUNKS_H__
+#define __MESH_CHUNKS_H__
+
+#include "cubePlacers.h"
+#include "greedyMesh.h"
+
+#include "pxr/base/gf/vec3f.h"
+#include "pxr/base/vt/types.h"
+#include "pxr/usd/sdf/layer.h"
+#include "pxr/usd/sdf/primSpec.h"
+#include "pxr/usd/sdf/attributeSpec.h"
+#include "pxr/usd/sdf/types.h"
+
+#include <algorithm>
+#include <map>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The bounds of a set of points, as an extent attribute value.
+static pxr::VtVec3fArray VoxelMeshExtent(const pxr::VtVec3fArray &points) {
+    using namespace pxr;
+    if (points.empty()) {
+        return VtVec3fArray();
+    }
+    GfVec3f lo = points[0], hi = points[0];
+    for (const GfVec3f &p : points) {
+        for (int axis = 0; axis < 3; axis++) {
+            lo[axis] = std::min(lo[axis], p[axis]);
+            hi[axis] = std::max(hi[axis], p[axis]);
+        }
+    }
+    return VtVec3fArray({ lo, hi });
+}
+
+// One cube of chunkSize^3 voxels of a mesh, in chunk coordinates.
+struct VoxelMeshChunk {
+    int32_t coord[3];
+    SdfMeshArrays arrays;
+};
+
+struct VoxelMeshComponent;
+
+// The connected components of a model's solid voxels, labelled on its voxel grid. Voxels touching across a face, an
+// edge or a corner (26-connectivity) are connected, so surfaces joined only through a solid interior are too.
+class VoxelSolidComponents {
+    static const uint32_t k_unlabelled = 0xffffffffu;
+
+    uint32_t size[3];
+    std::vector<uint32_t> labels;   // per cell: 0 if empty, else its component + 1
+
+    size_t cellIndex(uint32_t x, uint32_t y, uint32_t z) const {
+        return x + (size_t)size[0] * (y + (size_t)size[1] * z);
+    }
+
+public:
+    VoxelSolidComponents(uint32_t sizeX, uint32_t sizeY, uint32_t sizeZ)
+        : size{ sizeX, sizeY, sizeZ },
+          labels((size_t)sizeX * sizeY * sizeZ, 0)
+    {
+    }
+
+    void addSolid(uint32_t x, uint32_t y, uint32_t z) {
+        if (x < size[0] && y < size[1] && z < size[2]) {
+            labels[cellIndex(x, y, z)] = k_unlabelled;
+        }
+    }
+
+    // Labels the solid voxels added so far, by flood filling each component in turn.
+    void label() {
+        uint32_t next = 0;
+        std::vector<size_t> stack;
+        for (size_t i = 0; i < labels.size(); i++) {
+            if (labels[i] != k_unlabelled) {
+                continue;
+            }
+            const uint32_t component = ++next;
+            labels[i] = component;
+            stack.push_back(i);
+            while (!stack.empty()) {
+                size_t cell = stack.back();
+                stack.pop_back();
+                int32_t coord[3] = { (int32_t)(cell % size[0]), (int32_t)(cell / size[0] % size[1]),
+                                     (int32_t)(cell / ((size_t)size[0] * size[1])) };
+                for (int dz = -1; dz <= 1; dz++) {
+                for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    int32_t x = coord[0] + dx, y = coord[1] + dy, z = coord[2] + dz;
+                    if (x < 0 || y < 0 || z < 0 || (uint32_t)x >= size[0] || (uint32_t)y >= size[1] || (uint32_t)z >= size[2]) {
+                        continue;
+                    }
+                    size_t neighbour = cellIndex(x, y, z);
+                    if (labels[neighbour] == k_unlabelled) {
+                        labels[neighbour] = component;
+                        stack.push_back(neighbour);
+                    }
+                }
+                }
+                }
+            }
+        }
+    }
+
+    // The component of the voxel at x, y, z (counting from 1), or 0 if it's empty or outside the grid.
+    uint32_t componentOf(int32_t x, int32_t y, int32_t z) const {
+        if (x < 0 || y < 0 || z < 0 || (uint32_t)x >= size[0] || (uint32_t)y >= size[1] || (uint32_t)z >= size[2]) {
+            return 0;
+        }
+        return labels[cellIndex(x, y, z)];
+    }
+};
+
+// A model's mesh as it's authored: either one Mesh prim, or an Xform with a Mesh prim per chunk (with a chunk size)
+// or per connected component (with splitComponents), so that Hydra can cull, pick and invalidate each one on its own.
+// Components are chunked in turn if there's a chunk size as well.
+class VoxelChunkedMesh {
+    // Coordinates are packed 21 bits each, x first, offset so that keys sort like the coordinates do.
+    static const int32_t k_key_bias = 1 << 20;
+
+    static uint64_t packKey(const int32_t coord[3]) {
+        uint64_t key = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            key = (key << 21) | ((uint32_t)(coord[axis] + k_key_bias) & 0x1fffff);
+        }
+        return key;
+    }
+    static void unpackKey(uint64_t key, int32_t coord[3]) {
+        for (int axis = 2; axis >= 0; axis--) {
+            coord[axis] = (int32_t)(key & 0x1fffff) - k_key_bias;
+            key >>= 21;
+        }
+    }
+
+    // The given faces of a mesh, with only the points they use. remap must be all -1, and is left that way.
+    static SdfMeshArrays subsetFaces(const SdfMeshArrays &arrays, const std::vector<size_t> &faceStarts,
+                                     const std::vector<size_t> &faces, std::vector<int> &remap) {
+        using namespace pxr;
+        std::vector<GfVec3f> points;
+        std::vector<int> faceVertexIndices, faceVertexCounts;
+        std::vector<GfVec3f> displayColor, normals;
+        for (size_t f : faces) {
+            int count = arrays.faceVertexCounts[f];
+            for (int v = 0; v < count; v++) {
+                int index = arrays.faceVertexIndices[faceStarts[f] + v];
+                if (remap[index] < 0) {
+                    remap[index] = (int)points.size();
+                    points.push_back(arrays.points[index]);
+                }
+                faceVertexIndices.push_back(remap[index]);
+            }
+            faceVertexCounts.push_back(count);
+            displayColor.push_back(arrays.displayColor[f]);
+            normals.push_back(arrays.normals[f]);
+        }
+        // reset only the entries this subset used
+        for (size_t f : faces) {
+            for (int v = 0; v < arrays.faceVertexCounts[f]; v++) {
+                remap[arrays.faceVertexIndices[faceStarts[f] + v]] = -1;
+            }
+        }
+
+        SdfMeshArrays subset;
+        subset.points.assign(points.begin(), points.end());
+        subset.faceVertexIndices.assign(faceVertexIndices.begin(), faceVertexIndices.end());
+        subset.faceVertexCounts.assign(faceVertexCounts.begin(), faceVertexCounts.end());
+        subset.displayColor.assign(displayColor.begin(), displayColor.end());
+        subset.normals.assign(normals.begin(), normals.end());
+        return subset;
+    }
+
+    static std::vector<size_t> faceStartsOf(const SdfMeshArrays &arrays) {
+        std::vector<size_t> faceStarts(arrays.faceVertexCounts.size());
+        size_t start = 0;
+        for (size_t f = 0; f < faceStarts.size(); f++) {
+            faceStarts[f] = start;
+            start += arrays.faceVertexCounts[f];
+        }
+        return faceStarts;
+    }
+
+    void splitChunks(const SdfMeshArrays &arrays);
+    void splitConnectedComponents(const SdfMeshArrays &arrays, const VoxelSolidComponents *solid);
+
+public:
+    uint32_t chunkSize = 0;
+    bool splitComponents = false;
+    bool greedy = false;
+    SdfMeshArrays whole;                            // if neither chunkSize nor splitComponents is set
+    std::vector<VoxelMeshChunk> chunks;             // if only chunkSize is set; sorted by coord
+    std::vector<VoxelMeshComponent> components;     // if splitComponents is set; sorted by coord
+
+    VoxelChunkedMesh() = default;
+
+    // Splits the faces of a cube mesh by the chunk their cube falls in, and/or by the connected component of voxels
+    // it belongs to. A chunk size of 0 without splitComponents keeps it whole.
+    // Components are those of solid, labelled at the cubes' centers, if it's given. Otherwise (a .kvx only stores
+    // the voxels that can be seen) they're the cubes with faces that touch.
+    // Faces were culled against the whole model, so no faces appear along the seams between chunks.
+    // With greedy, the faces of each Mesh are then merged into rectangles (see VoxelGreedyMesh).
+    VoxelChunkedMesh(const SdfMeshArrays &arrays, uint32_t chunkSize, bool splitComponents = false, bool greedy = false,
+                     const VoxelSolidComponents *solid = nullptr)
+        : chunkSize(chunkSize),
+          splitComponents(splitComponents),
+          greedy(greedy)
+    {
+        if (splitComponents) {
+            splitConnectedComponents(arrays, solid);
+        } else if (chunkSize != 0) {
+            splitChunks(arrays);
+        } else {
+            whole = greedy ? VoxelGreedyMesh(arrays) : arrays;
+        }
+    }
+
+    // True if the mesh is authored as an Xform rather than a single Mesh.
+    bool isSplit() const {
+        return chunkSize != 0 || splitComponents;
+    }
+
+    pxr::SdfPrimSpecHandle writePrim(pxr::SdfLayerHandle layer, pxr::SdfPath path) const;
+};
+
+// One group of connected voxels (across faces, edges or corners), named after its lowest cube with faces.
+struct VoxelMeshComponent {
+    int32_t coord[3];
+    VoxelChunkedMesh mesh;
+};
+
+inline void VoxelChunkedMesh::splitChunks(const SdfMeshArrays &arrays) {
+    using namespace pxr;
+
+    const size_t numFaces = arrays.faceVertexCounts.size();
+    std::vector<size_t> faceStarts = faceStartsOf(arrays);
+    std::unordered_map<uint64_t, std::vector<size_t>> chunkFaces;
+
+    for (size_t f = 0; f < numFaces; f++) {
+        GfVec3f center = VoxelFaceCubeCenter(arrays, f, faceStarts[f]);
+        int32_t coord[3];
+        for (int axis = 0; axis < 3; axis++) {
+            // the half voxel keeps cube centers well away from the chunk boundaries
+            coord[axis] = (int32_t)floorf((center[axis] + 0.5f) / chunkSize);
+        }
+        chunkFaces[packKey(coord)].push_back(f);
+    }
+
+    std::vector<uint64_t> keys;
+    for (auto &entry : chunkFaces) {
+        keys.push_back(entry.first);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<int> remap(arrays.points.size(), -1);
+    chunks.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        unpackKey(keys[i], chunks[i].coord);
+        chunks[i].arrays = subsetFaces(arrays, faceStarts, chunkFaces[keys[i]], remap);
+        if (greedy) {
+            chunks[i].arrays = VoxelGreedyMesh(chunks[i].arrays);
+        }
+    }
+}
+
+inline void VoxelChunkedMesh::splitConnectedComponents(const SdfMeshArrays &arrays, const VoxelSolidComponents *solid) {
+    using namespace pxr;
+
+    const size_t numFaces = arrays.faceVertexCounts.size();
+    if (numFaces == 0) {
+        return;
+    }
+    std::vector<size_t> faceStarts = faceStartsOf(arrays);
+
+    // Cube centers are on a grid, but not necessarily an integer one (e.g. a .kvx's pivot), so they're
+    // measured from the first cube.
+    GfVec3f origin = VoxelFaceCubeCenter(arrays, 0, 0);
+    std::vector<uint64_t> faceCubes(numFaces);
+    std::unordered_map<uint64_t, uint32_t> cubeIndices;
+    std::vector<uint64_t> cubeKeys;
+    std::vector<uint32_t> cubeComponents;     // from solid, if it's given
+    for (size_t f = 0; f < numFaces; f++) {
+        GfVec3f center = VoxelFaceCubeCenter(arrays, f, faceStarts[f]);
+        int32_t coord[3];
+        for (int axis = 0; axis < 3; axis++) {
+            coord[axis] = (int32_t)lroundf(center[axis] - origin[axis]);
+        }
+        uint64_t key = packKey(coord);
+        faceCubes[f] = key;
+        if (cubeIndices.emplace(key, (uint32_t)cubeKeys.size()).second) {
+            cubeKeys.push_back(key);
+            if (solid) {
+                cubeComponents.push_back(solid->componentOf((int32_t)lroundf(center[0]), (int32_t)lroundf(center[1]),
+                                                            (int32_t)lroundf(center[2])));
+            }
+        }
+    }
+
+    // union-find over the cubes that have faces: cubes in the same component of solid, or else cubes that touch
+    // (interior cubes aren't in the mesh, but the cubes around them are still connected through their edges and
+    // corners)
+    std::vector<uint32_t> parent(cubeKeys.size());
+    for (uint32_t i = 0; i < parent.size(); i++) {
+        parent[i] = i;
+    }
+    auto find = [&](uint32_t i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    };
+    auto join = [&](uint32_t i, uint32_t j) {
+        uint32_t a = find(i), b = find(j);
+        if (a != b) {
+            parent[std::max(a, b)] = std::min(a, b);
+        }
+    };
+    if (solid) {
+        std::unordered_map<uint32_t, uint32_t> componentCubes;
+        for (uint32_t i = 0; i < cubeKeys.size(); i++) {
+            // a cube that isn't solid in the grid (if the mesh and grid disagree) is a component of its own
+            if (cubeComponents[i] != 0) {
+                join(i, componentCubes.emplace(cubeComponents[i], i).first->second);
+            }
+        }
+    }
+    for (uint32_t i = 0; i < cubeKeys.size() && !solid; i++) {
+        int32_t coord[3];
+        unpackKey(cubeKeys[i], coord);
+        for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            int32_t neighbour[3] = { coord[0] + dx, coord[1] + dy, coord[2] + dz };
+            auto it = cubeIndices.find(packKey(neighbour));
+            if (it != cubeIndices.end()) {
+                join(i, it->second);
+            }
+        }
+        }
+        }
+    }
+
+    // each component is keyed by its lowest cube
+    std::unordered_map<uint32_t, uint64_t> rootKeys;
+    for (uint32_t i = 0; i < cubeKeys.size(); i++) {
+        auto it = rootKeys.emplace(find(i), cubeKeys[i]).first;
+        it->second = std::min(it->second, cubeKeys[i]);
+    }
+    std::map<uint64_t, std::vector<size_t>> componentFaces;
+    for (size_t f = 0; f < numFaces; f++) {
+        componentFaces[rootKeys[find(cubeIndices[faceCubes[f]])]].push_back(f);
+    }
+
+    std::vector<int> remap(arrays.points.size(), -1);
+    for (auto &entry : componentFaces) {
+        VoxelMeshComponent component;
+        unpackKey(entry.first, component.coord);
+        // back to the coordinates the cubes were placed at (to the nearest voxel, if they were offset)
+        for (int axis = 0; axis < 3; axis++) {
+            component.coord[axis] += (int32_t)lroundf(origin[axis]);
+        }
+        component.mesh = VoxelChunkedMesh(subsetFaces(arrays, faceStarts, entry.second, remap), chunkSize, false, greedy);
+        components.push_back(std::move(component));
+    }
+}
+
+// A name like chunk_0_m1_2 for (0,-1,2).
+static std::string VoxelCoordName(const char *prefix, const int32_t coord[3]) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s_%s%d_%s%d_%s%d", prefix,
+             coord[0] < 0 ? "m" : "", abs(coord[0]),
+             coord[1] < 0 ? "m" : "", abs(coord[1]),
+             coord[2] < 0 ? "m" : "", abs(coord[2]));
+    return name;
+}
+
+// Authors the mesh at path, with an extent on every Mesh prim. Chunk and component prims are named after their
+// coordinates, e.g. chunk_0_m1_2 for (0,-1,2), so they keep their paths when other chunks or components of the
+// model change.
+inline pxr::SdfPrimSpecHandle VoxelChunkedMesh::writePrim(pxr::SdfLayerHandle layer, pxr::SdfPath path) const {
+    using namespace pxr;
+
+    if (!isSplit()) {
+        auto prim = whole.writePrim(layer, path);
+        if (!whole.points.empty()) {
+            auto attr = SdfAttributeSpec::New(prim, "extent", SdfValueTypeNames->Float3Array);
+            attr->SetDefaultValue(VtValue(VoxelMeshExtent(whole.points)));
+        }
+        return prim;
+    }
+    auto prim = SdfCreatePrimInLayer(layer, path);
+    prim->SetSpecifier(SdfSpecifierDef);
+    prim->SetTypeName("Xform");
+    for (const VoxelMeshChunk &chunk : chunks) {
+        auto chunkPrim = chunk.arrays.writePrim(layer, path.AppendChild(TfToken(VoxelCoordName("chunk", chunk.coord))));
+        auto attr = SdfAttributeSpec::New(chunkPrim, "extent", SdfValueTypeNames->Float3Array);
+        attr->SetDefaultValue(VtValue(VoxelMeshExtent(chunk.arrays.points)));
+    }
+    for (const VoxelMeshComponent &component : components) {
+        component.mesh.writePrim(layer, path.AppendChild(TfToken(VoxelCoordName("part", component.coord))));
+    }
+    return prim;
+}
+
+#endif
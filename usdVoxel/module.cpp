@@ -0,0 +1,9 @@
+#include "pxr/pxr.h"
+#include "pxr/base/tf/pyModule.h"
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+TF_WRAP_MODULE
+{
+    TF_WRAP(UsdVoxelPreload);
+}
@@ -336,7 +336,11 @@
         uint32_t       size_y;        // number of voxels in the local y dimension
         uint32_t       size_z;        // number of voxels in the local z dimension
         uint32_t       voxel_hash;    // hash of the content of the grid.
-        const uint8_t* voxel_data;    // grid of voxel data comprising color indices in x -> y -> z order. a color index of 0 means empty, all other indices mean solid and can be used to index the scene's palette to obtain the color for the voxel.
+        const uint8_t* voxel_data;    // grid of voxel data comprising color indices in x -> y -> z order. a color index of 0 means empty, all other indices mean solid and can be used to index the scene's palette to obtain the color for the voxel. NULL for sparse models.
+        uint32_t       num_packed_voxels;  // number of solid voxels in packed_voxel_data. only set for sparse models.
+        const uint8_t* packed_voxel_data;  // sparse models only (see k_read_scene_flags_sparse_models): x,y,z,color_index 4-tuples of the solid voxels, sorted in x -> y -> z order like the dense grid, with no duplicate coordinates. NULL for dense models.
+        uint32_t       num_deferred_voxels;   // number of voxels in deferred_voxel_data. only set for deferred models.
+        const uint8_t* deferred_voxel_data;   // deferred models only (see k_read_scene_flags_deferred_models): the raw contents of the XYZI chunk, pointing into the buffer the scene was read from. decode with ogt_vox_read_deferred_model.
     } ogt_vox_model;
 
     // a keyframe for animation of a transform
@@ -412,6 +416,7 @@
         ogt_vox_matl_array      materials;      // the extended materials for this scene
         uint32_t                num_cameras;    // number of cameras for this scene
         const ogt_vox_cam*      cameras;        // the cameras for this scene
+        uint8_t                 color_index_remap[256]; // maps color indices as stored in the file to indices into palette. already applied to all models except deferred ones.
     } ogt_vox_scene;
 
     // allocate memory function interface. pass in size, and get a pointer to memory with at least that size available.
@@ -437,17 +442,28 @@
     static const uint32_t k_read_scene_flags_keyframes                   = 1 << 1; // if specified, all instances and groups will contain keyframe data.
     static const uint32_t k_read_scene_flags_keep_empty_models_instances = 1 << 2; // if specified, all empty models and instances referencing those will be kept rather than culled.
     static const uint32_t k_read_scene_flags_keep_duplicate_models       = 1 << 3; // if specified, we do not de-duplicate models.
+    static const uint32_t k_read_scene_flags_sparse_models               = 1 << 4; // if specified, models whose packed voxel list is smaller than their dense grid keep the list instead (voxel_data is NULL, packed_voxel_data is set). implies k_read_scene_flags_keep_duplicate_models. sparse models can't be written or merged.
+    static const uint32_t k_read_scene_flags_deferred_models             = 1 << 5; // if specified, XYZI chunks are not decoded: models only have their size, and deferred_voxel_data pointing into the input buffer, which must outlive the scene. voxel_hash is the hash of the raw chunk. implies k_read_scene_flags_keep_duplicate_models. deferred models can't be written or merged.
 
     // creates a scene from a vox file within a memory buffer of a given size.
     // you can destroy the input buffer once you have the scene as this function will allocate separate memory for the scene objecvt.
-    const ogt_vox_scene* ogt_vox_read_scene(const uint8_t* buffer, uint32_t buffer_size);
+    // buffer_size is 64-bit, so files bigger than 4GB (eg. with many large models) can be read.
+    const ogt_vox_scene* ogt_vox_read_scene(const uint8_t* buffer, size_t buffer_size);
 
     // just like ogt_vox_read_scene, but you can additionally pass a union of k_read_scene_flags
-    const ogt_vox_scene* ogt_vox_read_scene_with_flags(const uint8_t* buffer, uint32_t buffer_size, uint32_t read_flags);
+    const ogt_vox_scene* ogt_vox_read_scene_with_flags(const uint8_t* buffer, size_t buffer_size, uint32_t read_flags);
 
     // destroys a scene object to release its memory.
     void ogt_vox_destroy_scene(const ogt_vox_scene* scene);
 
+    // decodes a model of a scene read with k_read_scene_flags_deferred_models. read_flags may include k_read_scene_flags_sparse_models.
+    // the model can also be a copy of one of the scene's models, with deferred_voxel_data pointing at the XYZI contents fetched from elsewhere.
+    // returns NULL if the model is NULL or the allocation fails. destroy the result with ogt_vox_destroy_model.
+    const ogt_vox_model* ogt_vox_read_deferred_model(const ogt_vox_scene* scene, const ogt_vox_model* model, uint32_t read_flags);
+
+    // destroys a model returned by ogt_vox_read_deferred_model.
+    void ogt_vox_destroy_model(const ogt_vox_model* model);
+
     // writes the scene to a new buffer and returns the buffer size. free the buffer with ogt_vox_free
     uint8_t* ogt_vox_write_scene(const ogt_vox_scene* scene, uint32_t* buffer_size);
 
@@ -552,6 +568,9 @@
     static inline uint32_t _vox_min(uint32_t a, uint32_t b) {
         return (a < b) ? a : b;
     }
+    static inline size_t _vox_min_size(size_t a, size_t b) {
+        return (a < b) ? a : b;
+    }
 
     // string utilities
     #ifdef _MSC_VER
@@ -588,11 +607,11 @@
     // API for emulating file transactions on an in-memory buffer of data.
     struct _vox_file {
         const  uint8_t* buffer;       // source buffer data
-        const uint32_t  buffer_size;  // size of the data in the buffer
-        uint32_t        offset;       // current offset in the buffer data.
+        const size_t    buffer_size;  // size of the data in the buffer
+        size_t          offset;       // current offset in the buffer data.
     };
 
-    static uint32_t _vox_file_bytes_remaining(const _vox_file* fp) {
+    static size_t _vox_file_bytes_remaining(const _vox_file* fp) {
         if (fp->offset < fp->buffer_size) {
             return fp->buffer_size - fp->offset;
         } else {
@@ -601,7 +620,7 @@
     }
 
     static bool _vox_file_read(_vox_file* fp, void* data, uint32_t data_size) {
-        size_t data_to_read = _vox_min(_vox_file_bytes_remaining(fp), data_size);
+        size_t data_to_read = _vox_min_size(_vox_file_bytes_remaining(fp), data_size);
         memcpy(data, &fp->buffer[fp->offset], data_to_read);
         fp->offset += data_size;
         return data_to_read == data_size;
@@ -637,8 +656,8 @@
         return ret;
     }
 
-    static void _vox_file_seek_forwards(_vox_file* fp, uint32_t offset) {
-        fp->offset += _vox_min(offset, _vox_file_bytes_remaining(fp));
+    static void _vox_file_seek_forwards(_vox_file* fp, size_t offset) {
+        fp->offset += _vox_min_size(offset, _vox_file_bytes_remaining(fp));
     }
 
     static const void* _vox_file_data_pointer(const _vox_file* fp) {
@@ -646,13 +665,56 @@
     }
 
     // hash utilities
-    static uint32_t _vox_hash(const uint8_t* data, uint32_t data_size) {
+    static uint32_t _vox_hash(const uint8_t* data, size_t data_size) {
         uint32_t hash = 0;
-        for (uint32_t i = 0; i < data_size; i++)
+        for (size_t i = 0; i < data_size; i++)
             hash = data[i] + (hash * 65559);
         return hash;
     }
 
+    // sorts packed x,y,z,color_index voxels into x -> y -> z order (the order of the dense grid) with a stable
+    // 3-pass radix sort, drops empty and out-of-bounds voxels, and keeps only the last of any duplicate coordinates
+    // (matching what writing them into a dense grid would do). returns the number of voxels written to out_voxels.
+    static uint32_t _vox_sort_packed_voxels(uint8_t* out_voxels, uint8_t* scratch, const uint8_t* in_voxels, uint32_t num_voxels, uint32_t size_x, uint32_t size_y, uint32_t size_z) {
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < num_voxels; i++) {
+            const uint8_t* v = &in_voxels[i * 4];
+            ogt_assert(v[0] < size_x && v[1] < size_y && v[2] < size_z, "invalid data in XYZI chunk");
+            if (v[3] == 0 || v[0] >= size_x || v[1] >= size_y || v[2] >= size_z)
+                continue;
+            memcpy(&out_voxels[count * 4], v, 4);
+            count++;
+        }
+        uint8_t* src = out_voxels;
+        uint8_t* dst = scratch;
+        for (uint32_t pass = 0; pass < 3; pass++) {
+            uint32_t offsets[256] = {};
+            for (uint32_t i = 0; i < count; i++)
+                offsets[src[i * 4 + pass]]++;
+            uint32_t total = 0;
+            for (uint32_t b = 0; b < 256; b++) {
+                uint32_t n = offsets[b];
+                offsets[b] = total;
+                total += n;
+            }
+            for (uint32_t i = 0; i < count; i++)
+                memcpy(&dst[offsets[src[i * 4 + pass]]++ * 4], &src[i * 4], 4);
+            uint8_t* tmp = src;
+            src = dst;
+            dst = tmp;
+        }
+        // after an odd number of passes the sorted voxels are in scratch. copy them back while dropping duplicates.
+        uint32_t unique = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            const uint8_t* v = &src[i * 4];
+            if (i + 1 < count && v[0] == v[4] && v[1] == v[5] && v[2] == v[6])
+                continue;
+            memmove(&out_voxels[unique * 4], v, 4);
+            unique++;
+        }
+        return unique;
+    }
+
     // memory allocation utils.
     static void* _ogt_priv_alloc_default(size_t size) { return malloc(size); }
     static void  _ogt_priv_free_default(void* ptr)    { free(ptr); }
@@ -1241,7 +1303,7 @@
             return false;
         // Finally, we know their hashes are the same, and their dimensions are the same
         // but they are only equal if they have exactly the same voxel data.
-        uint32_t num_voxels_lhs = lhs->size_x * lhs->size_y * lhs->size_z;
+        size_t num_voxels_lhs = (size_t)lhs->size_x * lhs->size_y * lhs->size_z;
         return memcmp(lhs->voxel_data, rhs->voxel_data, num_voxels_lhs) == 0 ? true : false;
     }
 
@@ -1357,7 +1419,75 @@
         return group->transform_anim.num_keyframes ? ogt_vox_sample_anim_transform(&group->transform_anim, frame_index) : group->transform;
     }
 
-    const ogt_vox_scene* ogt_vox_read_scene_with_flags(const uint8_t * buffer, uint32_t buffer_size, uint32_t read_flags) {
+    // builds a model from the contents of an XYZI chunk. color_remap (if not NULL) is applied to every color index.
+    // the model is sparse if requested and the packed list is smaller than the dense grid. returns NULL if allocation fails.
+    static ogt_vox_model* _vox_decode_xyzi(const uint8_t* packed_voxel_data, uint32_t voxels_to_read, uint32_t size_x, uint32_t size_y, uint32_t size_z, bool sparse, const uint8_t* color_remap) {
+        if (voxels_to_read != 0 && sparse && (uint64_t)voxels_to_read * 4 < (uint64_t)size_x * size_y * size_z) {
+            // keep the packed list. memory scales with the voxel count rather than the bounding volume.
+            ogt_vox_model * model = (ogt_vox_model*)_vox_calloc(sizeof(ogt_vox_model) + (size_t)voxels_to_read * 4);     // 4 bytes for each solid voxel
+            uint8_t * scratch = (uint8_t*)_vox_malloc((size_t)voxels_to_read * 4 + 4);
+            if (!model || !scratch) {
+                _vox_free(model);
+                _vox_free(scratch);
+                return NULL;
+            }
+            uint8_t * packed_data = (uint8_t*)&model[1];
+
+            model->size_x = size_x;
+            model->size_y = size_y;
+            model->size_z = size_z;
+            model->voxel_data = NULL;
+            model->packed_voxel_data = packed_data;
+            model->num_packed_voxels = _vox_sort_packed_voxels(packed_data, scratch, packed_voxel_data, voxels_to_read, size_x, size_y, size_z);
+            _vox_free(scratch);
+            if (color_remap) {
+                for (uint32_t i = 0; i < model->num_packed_voxels; i++)
+                    packed_data[i * 4 + 3] = color_remap[packed_data[i * 4 + 3]];
+            }
+            model->voxel_hash = _vox_hash(packed_data, (size_t)model->num_packed_voxels * 4);
+            return model;
+        }
+
+        // the dense grid's size, rejected if it can't be allocated in this address space
+        uint64_t voxel_count_64 = (uint64_t)size_x * size_y * size_z;
+        if (voxel_count_64 > (uint64_t)(size_t)-1 - sizeof(ogt_vox_model))
+            return NULL;
+        size_t voxel_count = (size_t)voxel_count_64;
+        ogt_vox_model * model = (ogt_vox_model*)_vox_calloc(sizeof(ogt_vox_model) + voxel_count);        // 1 byte for each voxel
+        if (!model)
+            return NULL;
+        uint8_t * voxel_data = (uint8_t*)&model[1];
+
+        // now setup the model
+        model->size_x = size_x;
+        model->size_y = size_y;
+        model->size_z = size_z;
+        model->voxel_data = voxel_data;
+
+        // setup some strides for computing voxel index based on x/y/z
+        const size_t k_stride_x = 1;
+        const size_t k_stride_y = size_x;
+        const size_t k_stride_z = (size_t)size_x * size_y;
+
+        // read this many voxels and store it in voxel data.
+        for (uint32_t i = 0; i < voxels_to_read; i++) {
+            uint8_t x = packed_voxel_data[i * 4 + 0];
+            uint8_t y = packed_voxel_data[i * 4 + 1];
+            uint8_t z = packed_voxel_data[i * 4 + 2];
+            uint8_t color_index = packed_voxel_data[i * 4 + 3];
+            ogt_assert(x < size_x && y < size_y && z < size_z, "invalid data in XYZI chunk");
+            voxel_data[(x * k_stride_x) + (y * k_stride_y) + (z * k_stride_z)] = color_index;
+        }
+        if (color_remap) {
+            for (size_t j = 0; j < voxel_count; j++)
+                voxel_data[j] = color_remap[voxel_data[j]];
+        }
+        // compute the hash of the voxels in this model-- used to accelerate duplicate models checking.
+        model->voxel_hash = _vox_hash(voxel_data, voxel_count);
+        return model;
+    }
+
+    const ogt_vox_scene* ogt_vox_read_scene_with_flags(const uint8_t * buffer, size_t buffer_size, uint32_t read_flags) {
         _vox_file file = { buffer, buffer_size, 0 };
         _vox_file* fp = &file;
 
@@ -1377,8 +1507,12 @@
         uint32_t                     size_y = 0;
         uint32_t                     size_z = 0;
         uint8_t                      index_map[256];
+        uint8_t                      color_index_remap[256];
         bool                         found_index_map_chunk = false;
 
+        for (uint32_t i = 0; i < 256; i++)
+            color_index_remap[i] = (uint8_t)i;
+
         // size some of our arrays to prevent resizing during the parsing for smallish cases.
         model_ptrs.reserve(64);
         instances.reserve(256);
@@ -1442,40 +1576,29 @@
                     uint32_t num_voxels_in_chunk = 0;
                     _vox_file_read_uint32(fp, &num_voxels_in_chunk);
                     if (num_voxels_in_chunk != 0 || (read_flags & k_read_scene_flags_keep_empty_models_instances)) {
-                        uint32_t voxel_count = size_x * size_y * size_z;
-                        ogt_vox_model * model = (ogt_vox_model*)_vox_calloc(sizeof(ogt_vox_model) + voxel_count);        // 1 byte for each voxel
-                        if (!model)
-                            return NULL;
-                        uint8_t * voxel_data = (uint8_t*)&model[1];
-
-                        // insert the model into the model array
-                        model_ptrs.push_back(model);
-
-                        // now setup the model
-                        model->size_x = size_x;
-                        model->size_y = size_y;
-                        model->size_z = size_z;
-                        model->voxel_data = voxel_data;
-
-                        // setup some strides for computing voxel index based on x/y/z
-                        const uint32_t k_stride_x = 1;
-                        const uint32_t k_stride_y = size_x;
-                        const uint32_t k_stride_z = size_x * size_y;
-
-                        // read this many voxels and store it in voxel data.
                         const uint8_t * packed_voxel_data = (const uint8_t*)_vox_file_data_pointer(fp);
-                        const uint32_t voxels_to_read = _vox_min(_vox_file_bytes_remaining(fp) / 4, num_voxels_in_chunk);
-                        for (uint32_t i = 0; i < voxels_to_read; i++) {
-                            uint8_t x = packed_voxel_data[i * 4 + 0];
-                            uint8_t y = packed_voxel_data[i * 4 + 1];
-                            uint8_t z = packed_voxel_data[i * 4 + 2];
-                            uint8_t color_index = packed_voxel_data[i * 4 + 3];
-                            ogt_assert(x < size_x && y < size_y && z < size_z, "invalid data in XYZI chunk");
-                            voxel_data[(x * k_stride_x) + (y * k_stride_y) + (z * k_stride_z)] = color_index;
+                        const uint32_t voxels_to_read = (uint32_t)_vox_min_size(_vox_file_bytes_remaining(fp) / 4, num_voxels_in_chunk);
+                        ogt_vox_model * model = NULL;
+                        if (read_flags & k_read_scene_flags_deferred_models) {
+                            // just remember where the voxels are. they're decoded later, one model at a time.
+                            model = (ogt_vox_model*)_vox_calloc(sizeof(ogt_vox_model));
+                            if (!model)
+                                return NULL;
+                            model->size_x = size_x;
+                            model->size_y = size_y;
+                            model->size_z = size_z;
+                            model->num_deferred_voxels = voxels_to_read;
+                            model->deferred_voxel_data = packed_voxel_data;
+                            model->voxel_hash = _vox_hash(packed_voxel_data, voxels_to_read * 4);
+                        }
+                        else {
+                            model = _vox_decode_xyzi(packed_voxel_data, voxels_to_read, size_x, size_y, size_z, (read_flags & k_read_scene_flags_sparse_models) != 0, NULL);
+                            if (!model)
+                                return NULL;
                         }
-                        _vox_file_seek_forwards(fp, num_voxels_in_chunk * 4);
-                        // compute the hash of the voxels in this model-- used to accelerate duplicate models checking.
-                        model->voxel_hash = _vox_hash(voxel_data, size_x * size_y * size_z);
+                        // insert the model into the model array
+                        model_ptrs.push_back(model);
+                        _vox_file_seek_forwards(fp, (size_t)num_voxels_in_chunk * 4);
                     }
                     else {
                         model_ptrs.push_back(NULL);
@@ -2030,13 +2153,25 @@
                 materials.matl[i] = old_materials.matl[remapped_index];
             }
 
+            // deferred models are remapped when they're decoded.
+            for (uint32_t i = 0; i < 256; i++)
+                color_index_remap[i] = (uint8_t)(1 + index_map_inverse[i]);
+
             // ensure that all models are remapped so they are using display order palette indices.
             for (uint32_t i = 0; i < model_ptrs.size(); i++) {
                 ogt_vox_model* model = model_ptrs[i];
-                if (model) {
-                    uint32_t num_voxels = model->size_x * model->size_y * model->size_z;
+                if (model && model->deferred_voxel_data) {
+                    continue;
+                }
+                else if (model && model->packed_voxel_data) {
+                    uint8_t* packed = (uint8_t*)&model[1];
+                    for (uint32_t j = 0; j < model->num_packed_voxels; j++)
+                        packed[j * 4 + 3] = 1 + index_map_inverse[packed[j * 4 + 3]];
+                }
+                else if (model) {
+                    size_t num_voxels = (size_t)model->size_x * model->size_y * model->size_z;
                     uint8_t* voxels = (uint8_t*)&model[1];
-                    for (uint32_t j = 0; j < num_voxels; j++)
+                    for (size_t j = 0; j < num_voxels; j++)
                         voxels[j] = 1 + index_map_inverse[voxels[j]];
                 }
             }
@@ -2054,7 +2189,7 @@
         // check for models that are identical by doing a pair-wise compare. If we find identical
         // models, we'll end up with NULL gaps in the model_ptrs array, but instances will have
         // been remapped to keep the earlier model.
-        if (0 == (read_flags & k_read_scene_flags_keep_duplicate_models)) {
+        if (0 == (read_flags & (k_read_scene_flags_keep_duplicate_models | k_read_scene_flags_sparse_models | k_read_scene_flags_deferred_models))) {
             for (uint32_t i = 0; i < model_ptrs.size(); i++) {
                 if (!model_ptrs[i])
                     continue;
@@ -2199,6 +2334,8 @@
 
             // copy the materials.
             scene->materials = materials;
+
+            memcpy(scene->color_index_remap, color_index_remap, sizeof(color_index_remap));
         }
 
         if (g_progress_callback_func) {
@@ -2208,10 +2345,25 @@
         return scene;
     }
 
-    const ogt_vox_scene* ogt_vox_read_scene(const uint8_t* buffer, uint32_t buffer_size) {
+    const ogt_vox_scene* ogt_vox_read_scene(const uint8_t* buffer, size_t buffer_size) {
         return ogt_vox_read_scene_with_flags(buffer, buffer_size, 0);
     }
 
+    const ogt_vox_model* ogt_vox_read_deferred_model(const ogt_vox_scene* scene, const ogt_vox_model* deferred, uint32_t read_flags) {
+        if (!deferred)
+            return NULL;
+        const uint8_t* color_remap = NULL;
+        for (uint32_t i = 0; i < 256 && !color_remap; i++) {
+            if (scene->color_index_remap[i] != i)
+                color_remap = scene->color_index_remap;
+        }
+        return _vox_decode_xyzi(deferred->deferred_voxel_data, deferred->num_deferred_voxels, deferred->size_x, deferred->size_y, deferred->size_z, (read_flags & k_read_scene_flags_sparse_models) != 0, color_remap);
+    }
+
+    void ogt_vox_destroy_model(const ogt_vox_model* model) {
+        _vox_free((void*)model);
+    }
+
     void ogt_vox_destroy_scene(const ogt_vox_scene * _scene) {
         ogt_vox_scene* scene = const_cast<ogt_vox_scene*>(_scene);
         // free models from model array
@@ -2826,8 +2978,8 @@
         memset(used_mask, 0, 256);
         for (uint32_t model_index = 0; model_index < scene->num_models; model_index++) {
             const ogt_vox_model* model = scene->models[model_index];
-            uint32_t voxel_count = model->size_x * model->size_y * model->size_z;
-            for (uint32_t voxel_index = 0; voxel_index < voxel_count; voxel_index++) {
+            size_t voxel_count = (size_t)model->size_x * model->size_y * model->size_z;
+            for (size_t voxel_index = 0; voxel_index < voxel_count; voxel_index++) {
                 uint8_t color_index = model->voxel_data[voxel_index];
                 used_mask[color_index] = true;
             }
@@ -2996,13 +3148,13 @@
             // create copies of all models that have color indices remapped.
             for (uint32_t model_index = 0; model_index < scene->num_models; model_index++) {
                 const ogt_vox_model* model = scene->models[model_index];
-                uint32_t voxel_count = model->size_x * model->size_y * model->size_z;
+                size_t voxel_count = (size_t)model->size_x * model->size_y * model->size_z;
                 // clone the model
                 ogt_vox_model* override_model = (ogt_vox_model*)_vox_malloc(sizeof(ogt_vox_model) + voxel_count);
                 uint8_t * override_voxel_data = (uint8_t*)& override_model[1];
 
                 // remap all color indices in the cloned model so they reference the master palette now!
-                for (uint32_t voxel_index = 0; voxel_index < voxel_count; voxel_index++) {
+                for (size_t voxel_index = 0; voxel_index < voxel_count; voxel_index++) {
                     uint8_t  old_color_index = model->voxel_data[voxel_index];
                     uint32_t new_color_index = scene_color_index_to_master_map[old_color_index];
                     ogt_assert(new_color_index < 256, "color index out of bounds");
@@ -0,0 +1,146 @@
+#ifndef __POOLED_ARRAY_H__
+#define __POOLED_ARRAY_H__
+
+#include "pxr/base/vt/array.h"
+
+#include <mutex>
+#include <stdlib.h>
+#include <vector>
+
+// Growable scratch buffers that meshing writes into directly, and that are then handed to a VtArray
+// through Vt's foreign data source, so the finished arrays are never copied or reallocated.
+//
+// When the last VtArray referencing a buffer goes away, the buffer (and its capacity) goes back to a pool:
+// first one private to the releasing thread, then a shared one. Later meshing, including by later Read calls,
+// reuses that capacity instead of growing fresh arrays from nothing.
+//
+// Vt_ArrayForeignDataSource is the only way to have a VtArray adopt memory it didn't allocate; it's declared in
+// vt/array.h, and it's what VtArray's own foreign data constructor takes. Reusing VtArrays through reserve/resize
+// instead would copy every finished mesh out of the scratch buffer once more.
+
+template <class T>
+class VoxelBufferPool;
+
+template <class T>
+class VoxelPooledBuffer : public pxr::Vt_ArrayForeignDataSource {
+    friend class VoxelBufferPool<T>;
+
+    static void detached(pxr::Vt_ArrayForeignDataSource *self) {
+        VoxelBufferPool<T>::release(static_cast<VoxelPooledBuffer *>(self));
+    }
+
+    VoxelPooledBuffer()
+        : pxr::Vt_ArrayForeignDataSource(detached)
+    {
+
+    }
+
+public:
+    std::vector<T> storage;
+
+    // Wraps the storage in a VtArray. The buffer is owned by the array (and its copies) from here on.
+    pxr::VtArray<T> toVtArray() {
+        // A small mesh in a buffer grown by a much bigger one would pin all that capacity for as long as the
+        // layer lives. Copy those out (cheap, they're small) and put the buffer straight back in the pool.
+        size_t capacityBytes = storage.capacity() * sizeof(T);
+        if (storage.empty() || (capacityBytes > 64 * 1024 && storage.size() * 4 < storage.capacity())) {
+            pxr::VtArray<T> copy(storage.begin(), storage.end());
+            VoxelBufferPool<T>::release(this);
+            return copy;
+        }
+        return pxr::VtArray<T>(this, storage.data(), storage.size());
+    }
+};
+
+template <class T>
+class VoxelBufferPool {
+    // Keep at most this many idle buffers and bytes of idle capacity per thread, and this many bytes of idle
+    // capacity process-wide.
+    static const size_t k_max_thread_buffers = 4;
+    static const size_t k_max_thread_bytes = 32 * 1024 * 1024;
+    static const size_t k_max_shared_bytes = 256 * 1024 * 1024;
+
+    struct ThreadPool {
+        std::vector<VoxelPooledBuffer<T> *> buffers;
+        size_t bytes = 0;
+        ~ThreadPool() {
+            threadPoolDestroyed() = true;
+            for (auto buffer : buffers) {
+                delete buffer;
+            }
+        }
+    };
+
+    struct SharedPool {
+        std::mutex mutex;
+        std::vector<VoxelPooledBuffer<T> *> buffers;
+        size_t bytes = 0;
+    };
+
+    static ThreadPool &threadPool() {
+        static thread_local ThreadPool pool;
+        return pool;
+    }
+
+    // Set once this thread's pool has been destroyed (at thread exit), after which arrays released on the thread,
+    // e.g. by static destructors, go to the shared pool. A plain bool has no destructor, so it outlives the pool.
+    static bool &threadPoolDestroyed() {
+        static thread_local bool destroyed = false;
+        return destroyed;
+    }
+
+    static SharedPool &sharedPool() {
+        // leaked, so arrays released during static destruction can still return their buffers
+        static SharedPool *pool = new SharedPool;
+        return *pool;
+    }
+
+public:
+    // Returns an empty buffer, with whatever capacity it had the last time it was used.
+    static VoxelPooledBuffer<T> *acquire() {
+        VoxelPooledBuffer<T> *buffer = nullptr;
+        ThreadPool *local = threadPoolDestroyed() ? nullptr : &threadPool();
+        if (local && !local->buffers.empty()) {
+            buffer = local->buffers.back();
+            local->buffers.pop_back();
+            local->bytes -= buffer->storage.capacity() * sizeof(T);
+        } else {
+            SharedPool &shared = sharedPool();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            if (!shared.buffers.empty()) {
+                buffer = shared.buffers.back();
+                shared.buffers.pop_back();
+                shared.bytes -= buffer->storage.capacity() * sizeof(T);
+            }
+        }
+        if (!buffer) {
+            buffer = new VoxelPooledBuffer<T>();
+        }
+        buffer->storage.clear();
+        return buffer;
+    }
+
+    static void release(VoxelPooledBuffer<T> *buffer) {
+        size_t bytes = buffer->storage.capacity() * sizeof(T);
+        if (!threadPoolDestroyed()) {
+            ThreadPool &local = threadPool();
+            if (local.buffers.size() < k_max_thread_buffers && local.bytes + bytes <= k_max_thread_bytes) {
+                local.buffers.push_back(buffer);
+                local.bytes += bytes;
+                return;
+            }
+        }
+        {
+            SharedPool &shared = sharedPool();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            if (shared.bytes + bytes <= k_max_shared_bytes) {
+                shared.buffers.push_back(buffer);
+                shared.bytes += bytes;
+                return;
+            }
+        }
+        delete buffer;
+    }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include "preload.h"
+
+#include "pxr/base/arch/fileSystem.h"
+#include "pxr/base/work/loops.h"
+#include "pxr/usd/ar/resolvedPath.h"
+#include "pxr/usd/ar/resolver.h"
+#include "pxr/usd/ar/resolverContext.h"
+#include "pxr/usd/ar/resolverContextBinder.h"
+
+#include <stdio.h>
+
+using namespace pxr;
+
+// Asks the OS to start reading a file into the page cache. Non-local assets are left alone.
+static void adviseWillNeed(const std::string &assetPath) {
+    std::string layerPath;
+    SdfLayer::FileFormatArguments args;
+    if (!SdfLayer::SplitIdentifier(assetPath, &layerPath, &args)) {
+        return;
+    }
+    ArResolvedPath resolvedPath = ArGetResolver().Resolve(layerPath);
+    if (!resolvedPath) {
+        return;
+    }
+    FILE *file = ArchOpenFile(resolvedPath.GetPathString().c_str(), "rb");
+    if (!file) {
+        return;
+    }
+    // a count of 0 means the whole file
+    ArchFileAdvise(file, 0, 0, ArchFileAdviceWillNeed);
+    fclose(file);
+}
+
+SdfLayerRefPtrVector UsdVoxelPreloadLayers(const std::vector<std::string> &assetPaths) {
+    SdfLayerRefPtrVector layers(assetPaths.size());
+    // the resolver context is per thread, so carry the caller's over to the workers
+    const ArResolverContext context = ArGetResolver().GetCurrentContext();
+
+    WorkParallelForN(assetPaths.size(), [&](size_t begin, size_t end) {
+        ArResolverContextBinder binder(context);
+        for (size_t i = begin; i < end; i++) {
+            adviseWillNeed(assetPaths[i]);
+        }
+    });
+
+    // one layer per task: conversion times vary a lot between assets
+    WorkParallelForN(assetPaths.size(), [&](size_t begin, size_t end) {
+        ArResolverContextBinder binder(context);
+        for (size_t i = begin; i < end; i++) {
+            layers[i] = SdfLayer::FindOrOpen(assetPaths[i]);
+        }
+    }, 1);
+
+    return layers;
+}
@@ -0,0 +1,20 @@
+#ifndef __PRELOAD_H__
+#define __PRELOAD_H__
+
+#include "pxr/usd/sdf/layer.h"
+
+#include <string>
+#include <vector>
+
+// Opens many layers (typically .vox and .kvx assets, with or without file format arguments) at once,
+// with SdfLayer::FindOrOpen on worker threads, so that a stage composed afterwards finds them already loaded.
+//
+// Read-ahead hints for every local file are issued before any layer is read, so the OS can fetch them in
+// the background while the first ones are being converted. Assets are resolved in the calling thread's
+// resolver context.
+//
+// Returns the layers in the order of assetPaths, with null for those that failed to open. Layers are only
+// kept in the registry while they're referenced, so hold on to the result until the stage has been opened.
+pxr::SdfLayerRefPtrVector UsdVoxelPreloadLayers(const std::vector<std::string> &assetPaths);
+
+#endif
@@ -0,0 +1,231 @@
+#include "readOptions.h"
+
+#include "pxr/base/tf/diagnostic.h"
+#include "pxr/base/vt/dictionary.h"
+#include "pxr/usd/sdf/layer.h"
+
+#include <algorithm>
+#include <stdlib.h>
+
+using namespace pxr;
+
+static bool parseBool(const SdfFileFormat::FileFormatArguments &args, const char *name, bool fallback) {
+    auto it = args.find(name);
+    if (it == args.end()) {
+        return fallback;
+    }
+    const std::string &value = it->second;
+    if (value == "1" || value == "true" || value == "yes" || value == "on") {
+        return true;
+    }
+    if (value == "0" || value == "false" || value == "no" || value == "off") {
+        return false;
+    }
+    TF_WARN("Ignoring invalid value '%s' for voxel file format argument '%s'", value.c_str(), name);
+    return fallback;
+}
+
+static int64_t parseInt(const SdfFileFormat::FileFormatArguments &args, const char *name, int64_t fallback) {
+    auto it = args.find(name);
+    if (it == args.end()) {
+        return fallback;
+    }
+    const char *begin = it->second.c_str();
+    char *end = nullptr;
+    long long value = strtoll(begin, &end, 10);
+    if (end == begin || *end != '\0') {
+        TF_WARN("Ignoring invalid value '%s' for voxel file format argument '%s'", begin, name);
+        return fallback;
+    }
+    return value;
+}
+
+// A comma separated list of names. Empty names are dropped.
+static std::vector<std::string> parseList(const SdfFileFormat::FileFormatArguments &args, const char *name) {
+    std::vector<std::string> list;
+    auto it = args.find(name);
+    if (it == args.end()) {
+        return list;
+    }
+    const std::string &value = it->second;
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos) {
+            end = value.size();
+        }
+        if (end > start) {
+            list.push_back(value.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return list;
+}
+
+static UsdVoxelRepresentation parseRepresentation(const SdfFileFormat::FileFormatArguments &args, UsdVoxelRepresentation fallback) {
+    auto it = args.find("representation");
+    if (it == args.end()) {
+        return fallback;
+    }
+    const std::string &value = it->second;
+    if (value == "mesh") {
+        return k_representation_mesh;
+    }
+    if (value == "greedyMesh") {
+        return k_representation_greedy_mesh;
+    }
+    if (value == "pointInstancer") {
+        return k_representation_point_instancer;
+    }
+    if (value == "points") {
+        return k_representation_points;
+    }
+    if (value == "auto") {
+        return k_representation_auto;
+    }
+    TF_WARN("Ignoring invalid value '%s' for voxel file format argument 'representation'", value.c_str());
+    return fallback;
+}
+
+// Six comma separated numbers, x0,y0,z0,x1,y1,z1: two opposite corners of a box.
+static bool parseBox(const SdfFileFormat::FileFormatArguments &args, const char *name, double lo[3], double hi[3]) {
+    auto it = args.find(name);
+    if (it == args.end()) {
+        return false;
+    }
+    double corners[6];
+    const char *p = it->second.c_str();
+    for (int i = 0; i < 6; i++) {
+        char *end = nullptr;
+        corners[i] = strtod(p, &end);
+        if (end == p || *end != (i < 5 ? ',' : '\0')) {
+            TF_WARN("Ignoring invalid value '%s' for voxel file format argument '%s'", it->second.c_str(), name);
+            return false;
+        }
+        p = end + 1;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        lo[axis] = std::min(corners[axis], corners[axis + 3]);
+        hi[axis] = std::max(corners[axis], corners[axis + 3]);
+    }
+    return true;
+}
+
+static bool parseCropUnits(const SdfFileFormat::FileFormatArguments &args, bool fallback) {
+    auto it = args.find("cropUnits");
+    if (it == args.end()) {
+        return fallback;
+    }
+    const std::string &value = it->second;
+    if (value == "world") {
+        return false;
+    }
+    if (value == "voxels") {
+        return true;
+    }
+    TF_WARN("Ignoring invalid value '%s' for voxel file format argument 'cropUnits'", value.c_str());
+    return fallback;
+}
+
+static UsdVoxelInstancing parseInstancing(const SdfFileFormat::FileFormatArguments &args, UsdVoxelInstancing fallback) {
+    auto it = args.find("instancing");
+    if (it == args.end()) {
+        return fallback;
+    }
+    const std::string &value = it->second;
+    if (value == "none") {
+        return k_instancing_none;
+    }
+    if (value == "instanceable") {
+        return k_instancing_instanceable;
+    }
+    if (value == "pointInstancer") {
+        return k_instancing_point_instancer;
+    }
+    TF_WARN("Ignoring invalid value '%s' for voxel file format argument 'instancing'", value.c_str());
+    return fallback;
+}
+
+UsdVoxelReadOptions UsdVoxelReadOptions::fromArguments(const SdfFileFormat::FileFormatArguments &args) {
+    UsdVoxelReadOptions options;
+    options.modelPayloads = parseBool(args, "payloads", options.modelPayloads);
+    options.model = parseInt(args, "model", options.model);
+    int64_t chunkSize = parseInt(args, "chunkSize", options.chunkSize);
+    if (chunkSize < 0 || chunkSize > UINT32_MAX) {
+        TF_WARN("Ignoring out of range voxel file format argument chunkSize=%lld", (long long)chunkSize);
+    } else {
+        options.chunkSize = (uint32_t)chunkSize;
+    }
+    options.splitComponents = parseBool(args, "splitComponents", options.splitComponents);
+    options.representation = parseRepresentation(args, options.representation);
+    options.instancing = parseInstancing(args, options.instancing);
+    options.layers = parseList(args, "layers");
+    options.excludeLayers = parseList(args, "excludeLayers");
+    options.groups = parseList(args, "groups");
+    options.excludeGroups = parseList(args, "excludeGroups");
+    options.instances = parseList(args, "instances");
+    options.excludeInstances = parseList(args, "excludeInstances");
+    options.hiddenLayers = parseBool(args, "hiddenLayers", options.hiddenLayers);
+    options.crop = parseBox(args, "crop", options.cropMin, options.cropMax);
+    options.cropVoxelUnits = parseCropUnits(args, options.cropVoxelUnits);
+    options.bvh = parseBool(args, "bvh", options.bvh);
+    options.mergeInstances = parseBool(args, "merge", options.mergeInstances);
+    options.cullSeams = parseBool(args, "cullSeams", options.cullSeams);
+    options.cullCavities = parseBool(args, "cullCavities", options.cullCavities);
+    return options;
+}
+
+const TfToken &UsdVoxelArgsField() {
+    static const TfToken field("usdVoxelArgs");
+    return field;
+}
+
+// The file format argument string for a metadata value.
+static bool argumentString(const VtValue &value, std::string *result) {
+    if (value.IsHolding<std::string>()) {
+        *result = value.UncheckedGet<std::string>();
+    } else if (value.IsHolding<TfToken>()) {
+        *result = value.UncheckedGet<TfToken>().GetString();
+    } else if (value.IsHolding<bool>()) {
+        *result = value.UncheckedGet<bool>() ? "1" : "0";
+    } else if (value.IsHolding<int>()) {
+        *result = std::to_string(value.UncheckedGet<int>());
+    } else if (value.IsHolding<int64_t>()) {
+        *result = std::to_string(value.UncheckedGet<int64_t>());
+    } else if (value.IsHolding<unsigned int>()) {
+        *result = std::to_string(value.UncheckedGet<unsigned int>());
+    } else if (value.IsHolding<uint64_t>()) {
+        *result = std::to_string(value.UncheckedGet<uint64_t>());
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void UsdVoxelComposeFileFormatArguments(const std::string &assetPath, const PcpDynamicFileFormatContext &context,
+                                        SdfFileFormat::FileFormatArguments *args) {
+    VtValue value;
+    if (!context.ComposeValue(UsdVoxelArgsField(), &value) || !value.IsHolding<VtDictionary>()) {
+        return;
+    }
+    std::string layerPath;
+    SdfLayer::FileFormatArguments explicitArgs;
+    SdfLayer::SplitIdentifier(assetPath, &layerPath, &explicitArgs);
+
+    for (const auto &entry : value.UncheckedGet<VtDictionary>()) {
+        if (explicitArgs.count(entry.first) != 0) {
+            continue;
+        }
+        std::string argument;
+        if (!argumentString(entry.second, &argument)) {
+            TF_WARN("Ignoring voxel file format argument '%s' in %s: it isn't a string, token, bool or integer",
+                    entry.first.c_str(), UsdVoxelArgsField().GetText());
+            continue;
+        }
+        (*args)[entry.first] = argument;
+    }
+}
+
+bool UsdVoxelCanFieldChangeAffectFileFormatArguments(const TfToken &field, const VtValue &oldValue, const VtValue &newValue) {
+    return field == UsdVoxelArgsField() && oldValue != newValue;
+}
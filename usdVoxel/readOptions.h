@@ -0,0 +1,91 @@
+#ifndef __READ_OPTIONS_H__
+#define __READ_OPTIONS_H__
+
+#include "pxr/base/tf/token.h"
+#include "pxr/base/vt/value.h"
+#include "pxr/usd/pcp/dynamicFileFormatContext.h"
+#include "pxr/usd/sdf/fileFormat.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum UsdVoxelInstancing {
+    k_instancing_none,              // each instance has a prim referencing its model
+    k_instancing_instanceable,      // ...and those references are instanceable, so USD shares their prototypes
+    k_instancing_point_instancer,   // ...and instances of the same model in the same group become one PointInstancer
+};
+
+enum UsdVoxelRepresentation {
+    k_representation_mesh,              // a Mesh with a quad per visible cube face
+    k_representation_greedy_mesh,       // ...with the faces in each plane merged into rectangles per color
+    k_representation_point_instancer,   // a PointInstancer with a Cube per surface voxel
+    k_representation_points,            // Points, one per surface voxel
+    k_representation_auto,              // whichever of the above is estimated to be cheapest, for each model
+};
+
+// Conversion options, parsed from a layer's file format arguments,
+// e.g. @scene.vox:SDF_FORMAT_ARGS:payloads=1@
+struct UsdVoxelReadOptions {
+    // payloads=1: author each .vox model as a payload back into the same file (with model=N) instead of meshing it,
+    // so that the stage's load rules decide which models get meshed.
+    bool modelPayloads = false;
+    // model=N: read only model N of a .vox file, as the Mesh prim /model.
+    int64_t model = -1;
+    // chunkSize=N: split each model's mesh into Mesh prims of NxNxN voxels. 0 keeps each model a single Mesh.
+    uint32_t chunkSize = 0;
+    // splitComponents=1: split each model's mesh into a Mesh prim per connected group of voxels.
+    bool splitComponents = false;
+    // representation=mesh|greedyMesh|pointInstancer|points|auto: how each .vox model (and a .kvx's /mesh) is authored.
+    // pointInstancer and points are never chunked or split.
+    UsdVoxelRepresentation representation = k_representation_mesh;
+    // instancing=instanceable|pointInstancer: how .vox instances are authored.
+    UsdVoxelInstancing instancing = k_instancing_none;
+    // bvh=1: put the instance prims of large .vox groups under a BVH of Xforms with extentsHint.
+    bool bvh = false;
+    // merge=1: merge the static instances directly under each .vox group into a single world-space Mesh.
+    bool mergeInstances = false;
+    // cullSeams=1: cull the faces of .vox instances that the voxels of neighbouring instances hide.
+    bool cullSeams = false;
+    // cullCavities=1: drop the faces of .vox models that face into sealed cavities, found by flood filling
+    // the empty space around each model.
+    bool cullCavities = false;
+
+    // layers=a,b and excludeLayers=a,b; groups=... and excludeGroups=...; instances=... and excludeInstances=...:
+    // convert only the .vox instances on the named layers, under groups with the named names (at any depth), and
+    // with the named names, leaving out any that are excluded. Models that no remaining instance uses aren't meshed.
+    std::vector<std::string> layers, excludeLayers;
+    std::vector<std::string> groups, excludeGroups;
+    std::vector<std::string> instances, excludeInstances;
+    // hiddenLayers=0: leave out the .vox instances on hidden layers.
+    bool hiddenLayers = true;
+
+    // crop=x0,y0,z0,x1,y1,z1: convert only the voxels whose centers are inside this box (bounds included).
+    // .kvx files don't decode the columns outside it; .vox instances whose bounds miss it are left out.
+    bool crop = false;
+    double cropMin[3] = { 0, 0, 0 };
+    double cropMax[3] = { 0, 0, 0 };
+    // cropUnits=world|voxels: whether the box is in the layer's coordinates, or in the file's own voxel grid
+    // (for .kvx, x right, y front and z down from the first voxel, before the pivot is applied).
+    bool cropVoxelUnits = false;
+
+    // True if any of the above leaves instances out.
+    bool filtersInstances() const {
+        return !layers.empty() || !excludeLayers.empty() || !groups.empty() || !excludeGroups.empty() ||
+               !instances.empty() || !excludeInstances.empty() || !hiddenLayers || crop;
+    }
+
+    static UsdVoxelReadOptions fromArguments(const pxr::SdfFileFormat::FileFormatArguments &args);
+};
+
+// The prim metadata field that the voxel file formats compose into the file format arguments of the layers a prim
+// has as payloads, as PcpDynamicFileFormatInterface (which Pcp doesn't apply to references): a dictionary of arguments,
+// e.g. usdVoxelArgs = { int chunkSize = 32, bool cullCavities = 1 }. Arguments in the asset path itself win.
+const pxr::TfToken &UsdVoxelArgsField();
+
+void UsdVoxelComposeFileFormatArguments(const std::string &assetPath, const pxr::PcpDynamicFileFormatContext &context,
+                                        pxr::SdfFileFormat::FileFormatArguments *args);
+
+bool UsdVoxelCanFieldChangeAffectFileFormatArguments(const pxr::TfToken &field, const pxr::VtValue &oldValue, const pxr::VtValue &newValue);
+
+#endif
@@ -0,0 +1,133 @@
+#include "voxAssetReader.h"
+
+#include <algorithm>
+#include <string.h>
+
+using namespace pxr;
+
+// Small enough that reading a chunk header next to a big XYZI chunk doesn't pull in much of its voxels.
+static const size_t k_window_size = 8 * 1024;
+
+static inline uint32_t voxChunkId(char a, char b, char c, char d) {
+    return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+}
+
+static inline uint32_t readLE32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void writeLE32(std::vector<uint8_t> &out, uint32_t value) {
+    uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+static const uint32_t k_chunk_vox  = voxChunkId('V','O','X',' ');
+static const uint32_t k_chunk_main = voxChunkId('M','A','I','N');
+static const uint32_t k_chunk_xyzi = voxChunkId('X','Y','Z','I');
+
+// Chunks whose contents ogt_vox reads. Anything else is left out of the scene altogether.
+static bool isSceneChunk(uint32_t id) {
+    static const uint32_t ids[] = {
+        voxChunkId('S','I','Z','E'), voxChunkId('R','G','B','A'), voxChunkId('n','T','R','N'),
+        voxChunkId('n','G','R','P'), voxChunkId('n','S','H','P'), voxChunkId('I','M','A','P'),
+        voxChunkId('L','A','Y','R'), voxChunkId('M','A','T','L'), voxChunkId('M','A','T','T'),
+        voxChunkId('r','C','A','M'),
+    };
+    return std::find(std::begin(ids), std::end(ids), id) != std::end(ids);
+}
+
+UsdVoxelVoxAssetReader::UsdVoxelVoxAssetReader()
+    : assetSize(0),
+      windowOffset(0)
+{
+
+}
+
+bool UsdVoxelVoxAssetReader::readAt(uint64_t offset, void *data, size_t size) {
+    if (offset < windowOffset || offset + size > windowOffset + window.size()) {
+        if (offset + size > assetSize) {
+            return false;
+        }
+        size_t windowSize = (size_t)std::min<uint64_t>(std::max(size, k_window_size), assetSize - offset);
+        window.resize(windowSize);
+        windowOffset = offset;
+        if (asset->Read(window.data(), windowSize, offset) != windowSize) {
+            window.clear();
+            return false;
+        }
+    }
+    memcpy(data, window.data() + (offset - windowOffset), size);
+    return true;
+}
+
+bool UsdVoxelVoxAssetReader::open(const std::shared_ptr<ArAsset> &asset) {
+    this->asset = asset;
+    assetSize = asset->GetSize();
+    modelChunks.clear();
+    scene.clear();
+    window.clear();
+
+    uint8_t header[8];
+    if (!readAt(0, header, sizeof(header)) || readLE32(header) != k_chunk_vox) {
+        return false;
+    }
+    scene.insert(scene.end(), header, header + sizeof(header));
+
+    // Children follow their parent's content, so walking chunk after chunk visits every chunk in the tree.
+    // The scene chunks are copied while they're still in the read window.
+    uint64_t offset = sizeof(header);
+    while (offset + 12 <= assetSize) {
+        uint8_t chunkHeader[12];
+        if (!readAt(offset, chunkHeader, sizeof(chunkHeader))) {
+            return false;
+        }
+        uint32_t id = readLE32(chunkHeader);
+        uint32_t size = readLE32(chunkHeader + 4);
+        uint64_t contentOffset = offset + 12;
+
+        if (id == k_chunk_main) {
+            writeLE32(scene, id);
+            writeLE32(scene, 0);
+            writeLE32(scene, 0);
+        } else if (id == k_chunk_xyzi) {
+            // keeps the model's place in the model order, without its voxels
+            modelChunks.push_back({ contentOffset, size });
+            writeLE32(scene, id);
+            writeLE32(scene, 4);
+            writeLE32(scene, 0);
+            writeLE32(scene, 0);
+        } else if (isSceneChunk(id)) {
+            // a chunk running past the end of the asset keeps what's there, and its header says so
+            size_t contentSize = (size_t)std::min<uint64_t>(size, assetSize - contentOffset);
+            size_t start = scene.size();
+            writeLE32(scene, id);
+            writeLE32(scene, (uint32_t)contentSize);
+            writeLE32(scene, 0);
+            scene.resize(start + 12 + contentSize);
+            if (!readAt(contentOffset, scene.data() + start + 12, contentSize)) {
+                return false;
+            }
+        }
+        offset = contentOffset + size;
+    }
+    return true;
+}
+
+uint32_t UsdVoxelVoxAssetReader::numModelVoxels(uint32_t modelIndex) const {
+    const Chunk &chunk = modelChunks[modelIndex];
+    return chunk.size < 4 ? 0 : (chunk.size - 4) / 4;
+}
+
+bool UsdVoxelVoxAssetReader::readModelVoxels(uint32_t modelIndex, std::vector<uint8_t> *voxels) const {
+    voxels->clear();
+    const Chunk &chunk = modelChunks[modelIndex];
+    uint8_t count[4];
+    if (chunk.size < 4 || chunk.offset + 4 > assetSize || asset->Read(count, 4, chunk.offset) != 4) {
+        return false;
+    }
+    // like ogt_vox, read no more voxels than are actually there
+    uint64_t available = std::min<uint64_t>(chunk.size - 4, assetSize - (chunk.offset + 4)) / 4;
+    uint64_t numVoxels = std::min<uint64_t>(readLE32(count), available);
+    voxels->resize(numVoxels * 4);
+    return asset->Read(voxels->data(), voxels->size(), chunk.offset + 4) == voxels->size();
+}
@@ -0,0 +1,57 @@
+#ifndef __VOX_ASSET_READER_H__
+#define __VOX_ASSET_READER_H__
+
+#include "pxr/usd/ar/asset.h"
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+// Reads a .vox file through ArAsset::Read, instead of pulling the whole file into memory with GetBuffer.
+//
+// open() walks the chunk headers, and only fetches the contents of the chunks that aren't voxels (the scene graph,
+// palette and materials; usually a few kilobytes). readModelVoxels() fetches one model's voxels when it's needed.
+class UsdVoxelVoxAssetReader {
+    struct Chunk {
+        uint64_t offset;    // of the chunk's content, after its header
+        uint32_t size;
+    };
+
+    std::shared_ptr<pxr::ArAsset> asset;
+    uint64_t assetSize;
+    std::vector<Chunk> modelChunks;     // the XYZI chunks, in model order
+    std::vector<uint8_t> scene;
+
+    // Reads are served from a window over the asset, so runs of small chunks take a single read.
+    // Only used by open().
+    std::vector<uint8_t> window;
+    uint64_t windowOffset;
+
+    bool readAt(uint64_t offset, void *data, size_t size);
+
+public:
+    UsdVoxelVoxAssetReader();
+
+    // Builds the chunk index, and reads everything but the voxels. Returns false if the asset isn't a .vox file.
+    bool open(const std::shared_ptr<pxr::ArAsset> &asset);
+
+    // A .vox file with the same chunks, except that every XYZI chunk is empty.
+    // Read it with k_read_scene_flags_deferred_models and k_read_scene_flags_keep_empty_models_instances,
+    // so that model i of the scene is model i here.
+    const std::vector<uint8_t> &sceneContents() const {
+        return scene;
+    }
+
+    uint32_t numModels() const {
+        return (uint32_t)modelChunks.size();
+    }
+
+    // The number of voxels in a model's XYZI chunk, without reading it.
+    uint32_t numModelVoxels(uint32_t modelIndex) const;
+
+    // Fetches the contents of a model's XYZI chunk: x,y,z,color_index 4-tuples.
+    // Safe to call from several threads at once.
+    bool readModelVoxels(uint32_t modelIndex, std::vector<uint8_t> *voxels) const;
+};
+
+#endif
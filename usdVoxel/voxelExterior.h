@@ -0,0 +1,83 @@
+#ifndef __VOXEL_EXTERIOR_H__
+#define __VOXEL_EXTERIOR_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+
+// The empty cells of a box of voxels that can be reached from outside it, found by flood filling from a one voxel
+// border around the box. Empty cells that aren't reached are sealed cavities, and faces opening onto them can
+// never be seen.
+class VoxelExterior {
+    enum : uint8_t { k_unreached = 0, k_reached = 1, k_solid = 2 };
+
+    int32_t origin[3];      // of the border
+    uint32_t size[3];       // including the border
+    std::vector<uint8_t> cells;
+
+    size_t index(int32_t x, int32_t y, int32_t z) const {
+        return (size_t)(x - origin[0]) + size[0] * ((size_t)(y - origin[1]) + (size_t)size[1] * (z - origin[2]));
+    }
+
+public:
+    // The box spans lo to lo + boxSize - 1 on each axis. forEachSolid(visit) calls visit(x, y, z) for each solid voxel.
+    template <class ForEachSolid>
+    VoxelExterior(const int32_t lo[3], const uint32_t boxSize[3], ForEachSolid forEachSolid) {
+        for (int axis = 0; axis < 3; axis++) {
+            origin[axis] = lo[axis] - 1;
+            size[axis] = boxSize[axis] + 2;
+        }
+        cells.assign((size_t)size[0] * size[1] * size[2], k_unreached);
+        forEachSolid([&](int32_t x, int32_t y, int32_t z) {
+            cells[index(x, y, z)] = k_solid;
+        });
+
+        // every border cell is outside; the fill spreads inwards from them
+        std::vector<size_t> stack;
+        for (uint32_t z = 0; z < size[2]; z++) {
+        for (uint32_t y = 0; y < size[1]; y++) {
+        for (uint32_t x = 0; x < size[0]; x++) {
+            if (x == 0 || y == 0 || z == 0 || x + 1 == size[0] || y + 1 == size[1] || z + 1 == size[2]) {
+                size_t i = x + size[0] * (y + (size_t)size[1] * z);
+                cells[i] = k_reached;
+                stack.push_back(i);
+            }
+        }
+        }
+        }
+        const size_t strideY = size[0];
+        const size_t strideZ = (size_t)size[0] * size[1];
+        while (!stack.empty()) {
+            size_t i = stack.back();
+            stack.pop_back();
+            uint32_t x = (uint32_t)(i % size[0]);
+            uint32_t y = (uint32_t)((i / strideY) % size[1]);
+            uint32_t z = (uint32_t)(i / strideZ);
+            size_t neighbours[6];
+            int count = 0;
+            if (x > 0) neighbours[count++] = i - 1;
+            if (x + 1 < size[0]) neighbours[count++] = i + 1;
+            if (y > 0) neighbours[count++] = i - strideY;
+            if (y + 1 < size[1]) neighbours[count++] = i + strideY;
+            if (z > 0) neighbours[count++] = i - strideZ;
+            if (z + 1 < size[2]) neighbours[count++] = i + strideZ;
+            for (int n = 0; n < count; n++) {
+                if (cells[neighbours[n]] == k_unreached) {
+                    cells[neighbours[n]] = k_reached;
+                    stack.push_back(neighbours[n]);
+                }
+            }
+        }
+    }
+
+    // True for empty cells that can be reached from outside the box, including every cell outside it.
+    bool contains(int32_t x, int32_t y, int32_t z) const {
+        if (x < origin[0] || y < origin[1] || z < origin[2] ||
+            x >= origin[0] + (int32_t)size[0] || y >= origin[1] + (int32_t)size[1] || z >= origin[2] + (int32_t)size[2]) {
+            return true;
+        }
+        return cells[index(x, y, z)] == k_reached;
+    }
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef __VOXEL_HASH_H__
+#define __VOXEL_HASH_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A fast, non-cryptographic 64-bit hash for voxel grids and palettes.
+// Consumes 8 bytes per round, so hashing a dense 256^3 model is cheap compared to meshing it.
+// Equal hashes don't imply equal content; callers must still compare the data on a match.
+
+static inline uint64_t VoxelHashMix(uint64_t h) {
+    // murmur3 finalizer
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline uint64_t VoxelHashCombine(uint64_t seed, uint64_t value) {
+    return VoxelHashMix(seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+}
+
+static inline uint64_t VoxelHash64(const void *data, size_t size, uint64_t seed = 0) {
+    const unsigned char *p = (const unsigned char *)data;
+    const uint64_t k = 0x9e3779b97f4a7c15ULL;
+    uint64_t h = seed ^ (size * k);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ VoxelHashMix(w)) * k;
+    }
+    if (i < size) {
+        uint64_t w = 0;
+        memcpy(&w, p + i, size - i);
+        h = (h ^ VoxelHashMix(w)) * k;
+    }
+    return VoxelHashMix(h);
+}
+
+// A second 64-bit hash, built from different rounds (xxhash64's), for checking a match on VoxelHash64 without
+// keeping the data it was computed from. The chance both collide on different data is negligible.
+static inline uint64_t VoxelHash64Check(const void *data, size_t size) {
+    const unsigned char *p = (const unsigned char *)data;
+    const uint64_t k1 = 0x9e3779b185ebca87ULL;
+    const uint64_t k2 = 0xc2b2ae3d27d4eb4fULL;
+    uint64_t h = 0x27d4eb2f165667c5ULL + size;
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        w *= k2;
+        w = (w << 31) | (w >> 33);
+        h ^= w * k1;
+        h = ((h << 27) | (h >> 37)) * k1 + 0x85ebca77c2b2ae63ULL;
+    }
+    for (; i < size; i++) {
+        h ^= p[i] * 0x165667b19e3779f9ULL;
+        h = ((h << 11) | (h >> 53)) * k1;
+    }
+    h ^= h >> 33;
+    h *= k2;
+    h ^= h >> 29;
+    h *= 0x165667b19e3779f9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+// The hashes of one buffer, each computed on first use, so that the caches keyed and checked by them share a
+// single pass over what may be a multi-gigabyte mapping. Not thread safe; the buffer must outlive it.
+class VoxelContentHashes {
+    const void *data;
+    size_t dataSize;
+    uint64_t contentHash = 0, contentCheck = 0;
+    bool hashed = false, checked = false;
+
+public:
+    VoxelContentHashes(const void *data, size_t size) : data(data), dataSize(size) {}
+
+    size_t size() const {
+        return dataSize;
+    }
+
+    // VoxelHash64 of the buffer.
+    uint64_t hash() {
+        if (!hashed) {
+            contentHash = VoxelHash64(data, dataSize);
+            hashed = true;
+        }
+        return contentHash;
+    }
+
+    // VoxelHash64Check of the buffer.
+    uint64_t check() {
+        if (!checked) {
+            contentCheck = VoxelHash64Check(data, dataSize);
+            checked = true;
+        }
+        return contentCheck;
+    }
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef __VOXEL_ORIENTATION_H__
+#define __VOXEL_ORIENTATION_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// One of the 48 axis-aligned orientations of a voxel grid (24 rotations, plus each of them mirrored).
+// Prototype axis i runs along target axis `axis[i]`, backwards if `flip[i]` is set.
+//
+// For a prototype with dims dp and a target with dims dt (where dp[i] == dt[axis[i]]),
+// prototype voxel p corresponds to target voxel q, where:
+//     q[axis[i]] = flip[i] ? dt[axis[i]] - 1 - p[i] : p[i]
+struct VoxelOrientation {
+    uint8_t axis[3];
+    bool flip[3];
+};
+
+static const int k_voxel_orientation_count = 48;
+
+// Index 0 is always the identity.
+static const VoxelOrientation *VoxelOrientations() {
+    struct Table {
+        VoxelOrientation orientations[k_voxel_orientation_count];
+        Table() {
+            static const uint8_t perms[6][3] = {
+                {0,1,2}, {0,2,1}, {1,0,2}, {1,2,0}, {2,0,1}, {2,1,0}
+            };
+            int n = 0;
+            for (int p = 0; p < 6; p++) {
+                for (int signs = 0; signs < 8; signs++) {
+                    VoxelOrientation &o = orientations[n++];
+                    for (int i = 0; i < 3; i++) {
+                        o.axis[i] = perms[p][i];
+                        o.flip[i] = (signs >> i) & 1;
+                    }
+                }
+            }
+        }
+    };
+    static const Table table;
+    return table.orientations;
+}
+
+// Returns true if the prototype grid, placed into the target with the given orientation, equals the target grid.
+// Grids are dense, x -> y -> z order, as in ogt_vox_model.
+static bool VoxelGridsMatchOriented(const uint32_t protoDims[3], const uint8_t *proto,
+                                    const uint32_t targetDims[3], const uint8_t *target,
+                                    const VoxelOrientation &o) {
+    for (int i = 0; i < 3; i++) {
+        if (protoDims[i] != targetDims[o.axis[i]]) {
+            return false;
+        }
+    }
+
+    const size_t targetStride[3] = { 1, targetDims[0], (size_t)targetDims[0] * targetDims[1] };
+
+    // Walking the prototype in memory order moves the target index by a fixed step along each axis
+    ptrdiff_t step[3];
+    size_t origin = 0;
+    for (int i = 0; i < 3; i++) {
+        size_t stride = targetStride[o.axis[i]];
+        if (o.flip[i]) {
+            origin += (protoDims[i] - 1) * stride;
+            step[i] = -(ptrdiff_t)stride;
+        } else {
+            step[i] = (ptrdiff_t)stride;
+        }
+    }
+
+    size_t p = 0;
+    for (uint32_t z = 0; z < protoDims[2]; z++) {
+        ptrdiff_t qz = origin + z * step[2];
+        for (uint32_t y = 0; y < protoDims[1]; y++) {
+            ptrdiff_t q = qz + y * step[1];
+            for (uint32_t x = 0; x < protoDims[0]; x++, p++, q += step[0]) {
+                if (proto[p] != target[q]) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Like VoxelGridsMatchOriented, for packed x,y,z,color_index voxel lists sorted in x -> y -> z order
+// (as in a sparse ogt_vox_model). Each prototype voxel is looked up in the target with a binary search,
+// so a wrong orientation is usually rejected after the first few voxels.
+static bool VoxelListsMatchOriented(const uint32_t protoDims[3], const uint8_t *proto, uint32_t protoCount,
+                                    const uint32_t targetDims[3], const uint8_t *target, uint32_t targetCount,
+                                    const VoxelOrientation &o) {
+    for (int i = 0; i < 3; i++) {
+        if (protoDims[i] != targetDims[o.axis[i]]) {
+            return false;
+        }
+    }
+    if (protoCount != targetCount) {
+        return false;
+    }
+
+    for (uint32_t n = 0; n < protoCount; n++) {
+        const uint8_t *p = &proto[n * 4];
+        uint32_t q[3];
+        for (int i = 0; i < 3; i++) {
+            q[o.axis[i]] = o.flip[i] ? targetDims[o.axis[i]] - 1 - p[i] : p[i];
+        }
+        uint32_t key = q[0] | (q[1] << 8) | (q[2] << 16);
+
+        uint32_t lo = 0, hi = targetCount;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            const uint8_t *t = &target[mid * 4];
+            uint32_t midKey = t[0] | (t[1] << 8) | (t[2] << 16);
+            if (midKey < key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo == targetCount) {
+            return false;
+        }
+        const uint8_t *t = &target[lo * 4];
+        if (t[0] != q[0] || t[1] != q[1] || t[2] != q[2] || t[3] != p[3]) {
+            return false;
+        }
+    }
+    // both lists have no duplicates and the same length, so every target voxel was matched exactly once
+    return true;
+}
+
+#endif
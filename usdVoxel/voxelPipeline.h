@@ -0,0 +1,94 @@
+#ifndef __VOXEL_PIPELINE_H__
+#define __VOXEL_PIPELINE_H__
+
+#include "pxr/base/work/dispatcher.h"
+#include "pxr/base/work/threadLimits.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdlib.h>
+#include <utility>
+#include <vector>
+
+// Runs produce(i) for every i in [0, count) on worker threads, and consume(i, result) on the calling thread,
+// strictly in order of i. This lets Sdf spec writes (which must stay on one thread) overlap with decoding and
+// meshing of the items after them.
+//
+// At most `window` items are produced ahead of the consumer, which bounds the memory held by finished results.
+// If the consumer reaches an item no worker has started yet, it produces that item itself rather than waiting,
+// so the pipeline can't stall when every worker thread is busy elsewhere (or when there are none).
+template <class Result, class Produce, class Consume>
+static void VoxelOrderedPipeline(size_t count, size_t window, Produce produce, Consume consume) {
+    if (pxr::WorkGetConcurrencyLimit() <= 1 || count <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            Result result = produce(i);
+            consume(i, result);
+        }
+        return;
+    }
+    if (window < 1) {
+        window = 1;
+    }
+
+    // Each slot is tagged with the item it currently holds and that item's state, so that a worker task
+    // for an item the consumer already produced can't claim the slot once it's reused for a later item.
+    enum { k_pending, k_claimed, k_done, k_num_states };
+    struct Slot {
+        std::atomic<size_t> tag;
+        Result result;
+    };
+    auto tag = [](size_t i, size_t state) { return i * k_num_states + state; };
+
+    std::unique_ptr<Slot[]> slots(new Slot[window]);
+    std::mutex mutex;
+    std::condition_variable doneCondition;
+
+    pxr::WorkDispatcher dispatcher;
+    auto submit = [&](size_t i) {
+        slots[i % window].tag = tag(i, k_pending);
+        dispatcher.Run([&, i]() {
+            Slot &slot = slots[i % window];
+            size_t expected = tag(i, k_pending);
+            if (!slot.tag.compare_exchange_strong(expected, tag(i, k_claimed))) {
+                // the consumer got here first and is producing it
+                return;
+            }
+            slot.result = produce(i);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                slot.tag = tag(i, k_done);
+            }
+            doneCondition.notify_all();
+        });
+    };
+
+    size_t next = 0;
+    for (; next < count && next < window; next++) {
+        submit(next);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        Slot &slot = slots[i % window];
+        size_t expected = tag(i, k_pending);
+        if (slot.tag.compare_exchange_strong(expected, tag(i, k_claimed))) {
+            slot.result = produce(i);
+        } else {
+            std::unique_lock<std::mutex> lock(mutex);
+            doneCondition.wait(lock, [&]() { return slot.tag == tag(i, k_done); });
+        }
+        Result result = std::move(slot.result);
+        slot.result = Result();
+
+        // keep the workers busy while this item's specs are written
+        if (next < count) {
+            submit(next++);
+        }
+        consume(i, result);
+    }
+
+    dispatcher.Wait();
+}
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef __VOXEL_REPRESENTATION_H__
+#define __VOXEL_REPRESENTATION_H__
+
+#include "cubePlacers.h"
+#include "greedyMesh.h"
+#include "meshChunks.h"
+#include "readOptions.h"
+
+#include "pxr/base/gf/vec3f.h"
+#include "pxr/base/vt/dictionary.h"
+#include "pxr/base/vt/types.h"
+#include "pxr/usd/sdf/layer.h"
+#include "pxr/usd/sdf/primSpec.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Each triangle drawn is counted as this many bytes, so that memory and draw cost add up to one estimate.
+static const double k_representation_triangle_cost = 32;
+// Points only stand in for cubes where voxels are scattered rather than forming surfaces: where the surface voxels
+// show at least this many faces each, on average.
+static const double k_representation_points_min_faces = 5;
+
+// The customData key recording which representation representation=auto chose for a prim, and why.
+static const char *k_representation_key = "voxelRepresentation";
+
+static const char *VoxelRepresentationName(UsdVoxelRepresentation representation) {
+    switch (representation) {
+    case k_representation_mesh: return "mesh";
+    case k_representation_greedy_mesh: return "greedyMesh";
+    case k_representation_point_instancer: return "pointInstancer";
+    case k_representation_points: return "points";
+    case k_representation_auto: return "auto";
+    }
+    return "mesh";
+}
+
+// The voxels of a cube mesh that have faces: the cube of each face, once, in the order they first appear.
+struct VoxelSurfaceCubes {
+    pxr::GfVec3f origin;            // of the first cube; the others are whole voxels away from it
+    std::vector<int32_t> cells;     // x, y, z of each cube, relative to origin
+    std::vector<pxr::GfVec3f> colors;
+
+    size_t size() const {
+        return colors.size();
+    }
+
+    explicit VoxelSurfaceCubes(const SdfMeshArrays &cubes = SdfMeshArrays()) : origin(0, 0, 0) {
+        using namespace pxr;
+        const size_t numFaces = cubes.faceVertexCounts.size();
+        if (numFaces == 0) {
+            return;
+        }
+        origin = VoxelFaceCubeCenter(cubes, 0, 0);
+        std::unordered_map<uint64_t, uint32_t> seen;
+        size_t start = 0;
+        for (size_t f = 0; f < numFaces; f++) {
+            GfVec3f center = VoxelFaceCubeCenter(cubes, f, start);
+            start += cubes.faceVertexCounts[f];
+            int32_t cell[3];
+            uint64_t key = 0;
+            for (int axis = 0; axis < 3; axis++) {
+                cell[axis] = (int32_t)lroundf(center[axis] - origin[axis]);
+                key = (key << 21) | ((uint32_t)(cell[axis] + (1 << 20)) & 0x1fffff);
+            }
+            if (seen.emplace(key, (uint32_t)colors.size()).second) {
+                cells.insert(cells.end(), cell, cell + 3);
+                colors.push_back(cubes.displayColor[f]);
+            }
+        }
+    }
+
+    // Places each cube through a SdfPointInstanceCubePlacer or SdfPointsCubePlacer.
+    template <class T>
+    void place(T &cubePlacer) const {
+        cubePlacer.setCentroid(-origin[0], -origin[1], -origin[2]);
+        for (size_t i = 0; i < colors.size(); i++) {
+            const pxr::GfVec3f &c = colors[i];
+            cubePlacer.place(cells[i * 3], cells[i * 3 + 1], cells[i * 3 + 2], c[0], c[1], c[2], k_cube_side_all);
+        }
+    }
+};
+
+// A model as it's authored, in the representation the read options ask for. With representation=auto, the model
+// is measured (voxel count, how many of its voxels are on the surface, how well its faces merge into rectangles),
+// and the representation with the lowest estimated memory and draw cost is chosen; the measurements and estimates
+// are recorded in the prim's customData, under voxelRepresentation.
+class VoxelModelRepresentation {
+public:
+    UsdVoxelRepresentation representation = k_representation_mesh;     // never auto
+    VoxelChunkedMesh mesh;          // for mesh and greedyMesh
+    VoxelSurfaceCubes surface;      // for pointInstancer and points
+    pxr::VtDictionary decision;     // for auto
+
+    VoxelModelRepresentation() = default;
+
+    // voxelCount is the number of solid voxels the cube mesh was built from, or 0 if only its surface is known.
+    // solid labels those voxels' components for splitComponents=1 (see VoxelChunkedMesh), if they're known.
+    VoxelModelRepresentation(const SdfMeshArrays &cubes, size_t voxelCount, const UsdVoxelReadOptions &options,
+                             const VoxelSolidComponents *solid = nullptr)
+        : representation(options.representation)
+    {
+        using namespace pxr;
+        if (representation == k_representation_mesh || representation == k_representation_greedy_mesh) {
+            mesh = VoxelChunkedMesh(cubes, options.chunkSize, options.splitComponents, representation == k_representation_greedy_mesh, solid);
+            return;
+        }
+        if (representation == k_representation_auto && cubes.faceVertexCounts.empty()) {
+            // nothing to measure
+            representation = k_representation_mesh;
+            mesh = VoxelChunkedMesh(cubes, options.chunkSize, options.splitComponents, false, solid);
+            return;
+        }
+        surface = VoxelSurfaceCubes(cubes);
+        if (representation != k_representation_auto) {
+            return;
+        }
+
+        SdfMeshArrays greedy = VoxelGreedyMesh(cubes);
+        const double faces = (double)cubes.faceVertexCounts.size();
+        const double greedyFaces = (double)greedy.faceVertexCounts.size();
+        const double surfaceVoxels = (double)surface.size();
+
+        double cost[4];
+        cost[k_representation_mesh] = cubes.memoryUsage() + 2 * faces * k_representation_triangle_cost;
+        cost[k_representation_greedy_mesh] = greedy.memoryUsage() + 2 * greedyFaces * k_representation_triangle_cost;
+        // a position, a color and a prototype index per voxel; every instance draws a whole cube
+        cost[k_representation_point_instancer] = surfaceVoxels * (2 * sizeof(GfVec3f) + sizeof(int))
+                                               + 12 * surfaceVoxels * k_representation_triangle_cost;
+        // a position and a color per voxel, drawn as a sprite
+        cost[k_representation_points] = surfaceVoxels * 2 * sizeof(GfVec3f) + 2 * surfaceVoxels * k_representation_triangle_cost;
+        bool pointsAllowed = faces >= k_representation_points_min_faces * surfaceVoxels;
+
+        representation = k_representation_mesh;
+        VtDictionary costs;
+        for (int r = k_representation_mesh; r <= k_representation_points; r++) {
+            if (r == k_representation_points && !pointsAllowed) {
+                continue;
+            }
+            costs[VoxelRepresentationName((UsdVoxelRepresentation)r)] = VtValue(cost[r]);
+            if (cost[r] < cost[representation]) {
+                representation = (UsdVoxelRepresentation)r;
+            }
+        }
+
+        decision["representation"] = VtValue(std::string(VoxelRepresentationName(representation)));
+        // unknown for a .kvx, which only stores its surface
+        if (voxelCount != 0) {
+            decision["voxels"] = VtValue((int64_t)voxelCount);
+            decision["surfaceRatio"] = VtValue(std::min(1.0, surfaceVoxels / voxelCount));
+        }
+        decision["faces"] = VtValue((int64_t)faces);
+        decision["greedyFaces"] = VtValue((int64_t)greedyFaces);
+        decision["greedyEfficiency"] = VtValue(faces > 0 ? 1 - greedyFaces / faces : 0.0);
+        decision["estimatedCost"] = VtValue(costs);
+
+        if (representation == k_representation_mesh || representation == k_representation_greedy_mesh) {
+            surface = VoxelSurfaceCubes();
+        }
+        if (representation == k_representation_mesh) {
+            mesh = VoxelChunkedMesh(cubes, options.chunkSize, options.splitComponents, false, solid);
+        } else if (representation == k_representation_greedy_mesh) {
+            if (options.chunkSize != 0 || options.splitComponents) {
+                mesh = VoxelChunkedMesh(cubes, options.chunkSize, options.splitComponents, true, solid);
+            } else {
+                mesh.greedy = true;
+                mesh.whole = greedy;
+            }
+        }
+    }
+
+    pxr::SdfPrimSpecHandle writePrim(pxr::SdfLayerHandle layer, pxr::SdfPath path) const {
+        using namespace pxr;
+        SdfPrimSpecHandle prim;
+        if (representation == k_representation_point_instancer) {
+            SdfPointInstanceCubePlacer cubePlacer;
+            surface.place(cubePlacer);
+            prim = cubePlacer.writePrim(layer, path);
+        } else if (representation == k_representation_points) {
+            SdfPointsCubePlacer cubePlacer;
+            surface.place(cubePlacer);
+            prim = cubePlacer.writePrim(layer, path);
+        } else {
+            prim = mesh.writePrim(layer, path);
+        }
+        if (!decision.empty()) {
+            prim->SetCustomData(k_representation_key, VtValue(decision));
+        }
+        return prim;
+    }
+};
+
+// The prim type a model is authored as, for payload stubs that stand in for it before it's loaded; empty if that
+// isn't known until the model is measured (representation=auto).
+static const char *VoxelRepresentationPrimType(const UsdVoxelReadOptions &options) {
+    switch (options.representation) {
+    case k_representation_point_instancer: return "PointInstancer";
+    case k_representation_points: return "Points";
+    case k_representation_auto: return "";
+    default: return options.chunkSize != 0 || options.splitComponents ? "Xform" : "Mesh";
+    }
+}
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef __VOXEL_SET_H__
+#define __VOXEL_SET_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+
+// An open-addressing hash set of 32-bit voxel keys, for neighbour lookups in sparse models.
+// Memory scales with the number of voxels inserted, not with the model's bounding volume.
+class VoxelKeySet {
+    std::vector<uint32_t> slots;    // key + 1, so that 0 marks an empty slot
+    uint32_t mask;
+
+    static uint32_t hashKey(uint32_t key) {
+        key ^= key >> 16;
+        key *= 0x7feb352dU;
+        key ^= key >> 15;
+        key *= 0x846ca68bU;
+        key ^= key >> 16;
+        return key;
+    }
+
+public:
+    explicit VoxelKeySet(size_t expectedCount) {
+        size_t capacity = 16;
+        while (capacity < expectedCount * 2) {
+            capacity *= 2;
+        }
+        slots.assign(capacity, 0);
+        mask = (uint32_t)(capacity - 1);
+    }
+
+    // keys must be less than UINT32_MAX
+    void insert(uint32_t key) {
+        uint32_t i = hashKey(key) & mask;
+        while (slots[i] != 0) {
+            if (slots[i] == key + 1) {
+                return;
+            }
+            i = (i + 1) & mask;
+        }
+        slots[i] = key + 1;
+    }
+
+    bool contains(uint32_t key) const {
+        uint32_t i = hashKey(key) & mask;
+        while (slots[i] != 0) {
+            if (slots[i] == key + 1) {
+                return true;
+            }
+            i = (i + 1) & mask;
+        }
+        return false;
+    }
+};
+
+// An open-addressing hash map from 64-bit voxel keys to color indices, for voxels gathered from several models
+// into one grid. Inserting a key again replaces its color. Size it for the expected count; it grows if that's exceeded.
+class VoxelColorMap {
+    struct Slot {
+        uint64_t key;       // key + 1, so that 0 marks an empty slot
+        uint8_t color;
+    };
+    std::vector<Slot> slots;
+    uint64_t mask;
+    size_t count;
+
+    static uint64_t hashKey(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+    void grow() {
+        std::vector<Slot> old;
+        old.swap(slots);
+        slots.assign(old.size() * 2, Slot{ 0, 0 });
+        mask = slots.size() - 1;
+        for (const Slot &slot : old) {
+            if (slot.key != 0) {
+                uint64_t i = hashKey(slot.key - 1) & mask;
+                while (slots[i].key != 0) {
+                    i = (i + 1) & mask;
+                }
+                slots[i] = slot;
+            }
+        }
+    }
+
+public:
+    explicit VoxelColorMap(size_t expectedCount)
+        : count(0)
+    {
+        size_t capacity = 16;
+        while (capacity < expectedCount * 2) {
+            capacity *= 2;
+        }
+        slots.assign(capacity, Slot{ 0, 0 });
+        mask = capacity - 1;
+    }
+
+    // keys must be less than UINT64_MAX
+    void insert(uint64_t key, uint8_t color) {
+        if ((count + 1) * 2 > slots.size()) {
+            grow();
+        }
+        uint64_t i = hashKey(key) & mask;
+        while (slots[i].key != 0) {
+            if (slots[i].key == key + 1) {
+                slots[i].color = color;
+                return;
+            }
+            i = (i + 1) & mask;
+        }
+        slots[i] = { key + 1, color };
+        count++;
+    }
+
+    // 0 if the key isn't in the map
+    uint8_t find(uint64_t key) const {
+        uint64_t i = hashKey(key) & mask;
+        while (slots[i].key != 0) {
+            if (slots[i].key == key + 1) {
+                return slots[i].color;
+            }
+            i = (i + 1) & mask;
+        }
+        return 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    template <class F>
+    void forEach(F visit) const {
+        for (const Slot &slot : slots) {
+            if (slot.key != 0) {
+                visit(slot.key - 1, slot.color);
+            }
+        }
+    }
+};
+
+#endif
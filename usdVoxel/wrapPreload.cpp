@@ -0,0 +1,30 @@
+#include "preload.h"
+
+#include "pxr/pxr.h"
+#include "pxr/base/tf/pyLock.h"
+#include "pxr/base/tf/pyResultConversions.h"
+
+// OpenUSD 24.11 replaced boost::python with its own copy
+#if PXR_VERSION >= 2411
+#include "pxr/external/boost/python/def.hpp"
+using namespace pxr_boost::python;
+#else
+#include <boost/python/def.hpp>
+using namespace boost::python;
+#endif
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+static SdfLayerRefPtrVector preloadLayers(const std::vector<std::string> &assetPaths) {
+    // conversions don't need Python; let other Python threads run meanwhile
+    TfPyAllowThreadsInScope allowThreads;
+    return UsdVoxelPreloadLayers(assetPaths);
+}
+
+void wrapUsdVoxelPreload()
+{
+    def("PreloadLayers", &preloadLayers, arg("assetPaths"),
+        return_value_policy<TfPySequenceToList>(),
+        "Opens the layers at the given asset paths concurrently, and returns them as a list (with None for those "
+        "that failed to open). Keep the list alive until the stage that uses them has been opened.");
+}
@@ -0,0 +1,301 @@
+// Converts .vox and .kvx files (or whole directories of them) to .usdc/.usda layers on all cores, in a single
+// process. Outputs whose source content, arguments and converter revision haven't changed are skipped.
+
+#include "converterRevision.h"
+#include "voxelHash.h"
+
+#include "pxr/base/arch/fileSystem.h"
+#include "pxr/base/tf/diagnostic.h"
+#include "pxr/base/tf/errorMark.h"
+#include "pxr/base/tf/fileUtils.h"
+#include "pxr/base/tf/pathUtils.h"
+#include "pxr/base/tf/stringUtils.h"
+#include "pxr/base/vt/dictionary.h"
+#include "pxr/base/work/loops.h"
+#include "pxr/base/work/threadLimits.h"
+#include "pxr/usd/sdf/layer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace pxr;
+
+// customLayerData key of each output, holding the key of the conversion that produced it.
+static const char *k_convert_key = "usdVoxelConvertKey";
+
+struct ConvertOptions {
+    std::string outputDir;      // empty: next to each input
+    std::string format = "usdc";
+    SdfLayer::FileFormatArguments args;
+    bool force = false;
+    bool verbose = false;
+};
+
+struct ConvertJob {
+    std::string input;
+    std::string output;
+};
+
+static void usage() {
+    fprintf(stderr,
+        "usage: usdVoxelConvert [options] <file or directory>...\n"
+        "\n"
+        "Converts .vox and .kvx files to USD layers. Directories are searched recursively.\n"
+        "\n"
+        "  -o, --output <dir>       write outputs under <dir>, mirroring the input directories\n"
+        "                           (default: next to each input)\n"
+        "  -f, --format usdc|usda   output format (default: usdc)\n"
+        "  --chunk-size <n>         split meshes into chunks of n^3 voxels (the chunkSize argument)\n"
+        "  --representation <r>     mesh, greedyMesh, pointInstancer, points or auto (the representation argument)\n"
+        "  --arg <name>=<value>     any other file format argument, e.g. --arg cullCavities=1\n"
+        "                           (payloads=1 only without -o: the payloads point at the input's file name)\n"
+        "  -j, --threads <n>        number of worker threads (default: all cores)\n"
+        "  --force                  convert even if an output is up to date\n"
+        "  -v, --verbose            list every file\n"
+        "\n"
+        "Levels of detail aren't generated: each file is converted at its full resolution.\n");
+}
+
+// The values UsdVoxelReadOptions accepts for the representation argument.
+static bool isRepresentation(const std::string &value) {
+    for (const char *representation : { "mesh", "greedyMesh", "pointInstancer", "points", "auto" }) {
+        if (value == representation) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool isVoxelFile(const std::string &path) {
+    std::string extension = TfStringToLower(TfGetExtension(path));
+    return extension == "vox" || extension == "kvx";
+}
+
+static std::string outputPath(const std::string &input, const std::string &root, const ConvertOptions &options) {
+    std::string relative = options.outputDir.empty() || root.empty()
+        ? TfGetBaseName(input)
+        : input.substr(root.size() + (input.size() > root.size() && input[root.size()] == '/' ? 1 : 0));
+    std::string name = TfStringGetBeforeSuffix(relative) + "." + options.format;
+    std::string dir = options.outputDir.empty() ? TfGetPathName(input) : options.outputDir;
+    // an input in the current directory has no directory part, and TfStringCatPaths("", name) would be "/name"
+    // normalized, so that the same output reached through different spellings of a path is recognized below
+    return TfNormPath(dir.empty() ? name : TfStringCatPaths(dir, name));
+}
+
+// A hash of everything the output depends on: the source's content, the arguments and the converter revision.
+static bool conversionKey(const std::string &input, const ConvertOptions &options, std::string *key) {
+    FILE *file = ArchOpenFile(input.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    uint64_t hash = VoxelHash64("usdVoxelConvert", 15);
+    std::vector<char> block(1 << 20);
+    size_t read;
+    while ((read = fread(block.data(), 1, block.size(), file)) > 0) {
+        hash = VoxelHash64(block.data(), read, hash);
+    }
+    bool failed = ferror(file) != 0;
+    fclose(file);
+    if (failed) {
+        return false;
+    }
+    hash = VoxelHashCombine(hash, k_converter_revision);
+    for (const auto &arg : options.args) {
+        hash = VoxelHashCombine(hash, VoxelHash64(arg.first.data(), arg.first.size()));
+        hash = VoxelHashCombine(hash, VoxelHash64(arg.second.data(), arg.second.size()));
+    }
+    *key = TfStringPrintf("%016llx", (unsigned long long)hash);
+    return true;
+}
+
+static bool isUpToDate(const std::string &output, const std::string &key) {
+    if (!TfIsFile(output)) {
+        return false;
+    }
+    SdfLayerRefPtr layer = SdfLayer::OpenAsAnonymous(output, /* metadataOnly */ true);
+    if (!layer) {
+        return false;
+    }
+    VtDictionary customData = layer->GetCustomLayerData();
+    auto it = customData.find(k_convert_key);
+    return it != customData.end() && it->second.IsHolding<std::string>() && it->second.UncheckedGet<std::string>() == key;
+}
+
+static bool convert(const ConvertJob &job, const std::string &key, const ConvertOptions &options) {
+    SdfLayerRefPtr source = SdfLayer::FindOrOpen(SdfLayer::CreateIdentifier(job.input, options.args));
+    if (!source) {
+        return false;
+    }
+    SdfLayerRefPtr layer = SdfLayer::CreateAnonymous("usdVoxelConvert." + options.format);
+    layer->TransferContent(source);
+    VtDictionary customData = layer->GetCustomLayerData();
+    customData[k_convert_key] = VtValue(key);
+    layer->SetCustomLayerData(customData);
+
+    const std::string dir = TfGetPathName(job.output);
+    if (!dir.empty() && !TfIsDir(dir) && !TfMakeDirs(dir, -1, /* existOk */ true)) {
+        return false;
+    }
+    // written under a temporary name and renamed into place, so an interrupted run never leaves a partial output
+    // that looks up to date
+    std::string tmpPath = TfStringPrintf("%s.%d.tmp.%s", TfStringGetBeforeSuffix(job.output).c_str(), ArchGetProcessId(), options.format.c_str());
+    if (!layer->Export(tmpPath)) {
+        TfDeleteFile(tmpPath);
+        return false;
+    }
+    if (rename(tmpPath.c_str(), job.output.c_str()) != 0) {
+        TfDeleteFile(tmpPath);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    ConvertOptions options;
+    std::vector<std::string> inputs;
+    int threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "usdVoxelConvert: %s needs a value\n", arg.c_str());
+                exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "-o" || arg == "--output") {
+            options.outputDir = value();
+        } else if (arg == "-f" || arg == "--format") {
+            options.format = value();
+            if (options.format != "usdc" && options.format != "usda") {
+                fprintf(stderr, "usdVoxelConvert: unknown format '%s'\n", options.format.c_str());
+                return 2;
+            }
+        } else if (arg == "--chunk-size") {
+            options.args["chunkSize"] = value();
+        } else if (arg == "--representation") {
+            std::string representation = value();
+            if (!isRepresentation(representation)) {
+                fprintf(stderr, "usdVoxelConvert: unknown representation '%s'\n", representation.c_str());
+                return 2;
+            }
+            options.args["representation"] = representation;
+        } else if (arg == "--arg") {
+            std::string nameValue = value();
+            size_t equals = nameValue.find('=');
+            if (equals == std::string::npos || equals == 0) {
+                fprintf(stderr, "usdVoxelConvert: --arg expects <name>=<value>, not '%s'\n", nameValue.c_str());
+                return 2;
+            }
+            options.args[nameValue.substr(0, equals)] = nameValue.substr(equals + 1);
+        } else if (arg == "-j" || arg == "--threads") {
+            threads = atoi(value().c_str());
+        } else if (arg == "--force") {
+            options.force = true;
+        } else if (arg == "-v" || arg == "--verbose") {
+            options.verbose = true;
+        } else if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        } else if (!arg.empty() && arg[0] == '-') {
+            fprintf(stderr, "usdVoxelConvert: unknown option '%s'\n", arg.c_str());
+            usage();
+            return 2;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty()) {
+        usage();
+        return 2;
+    }
+    if (threads > 0) {
+        WorkSetConcurrencyLimitArgument(threads);
+    }
+    // payloads=1 layers point back into "./<input file>", which only resolves next to the input
+    auto payloads = options.args.find("payloads");
+    if (!options.outputDir.empty() && payloads != options.args.end() &&
+        (payloads->second == "1" || payloads->second == "true" || payloads->second == "yes" || payloads->second == "on")) {
+        fprintf(stderr, "usdVoxelConvert: payloads=1 can't be used with -o, since the payloads refer to the input files "
+                        "by their names relative to the output\n");
+        return 2;
+    }
+
+    std::vector<ConvertJob> jobs;
+    for (const std::string &input : inputs) {
+        if (TfIsDir(input)) {
+            std::string root = TfNormPath(input);
+            std::vector<std::string> files = TfListDir(root, /* recursive */ true);
+            std::sort(files.begin(), files.end());
+            for (const std::string &file : files) {
+                if (isVoxelFile(file) && TfIsFile(file)) {
+                    jobs.push_back({ file, outputPath(file, root, options) });
+                }
+            }
+        } else if (TfIsFile(input)) {
+            jobs.push_back({ input, outputPath(input, std::string(), options) });
+        } else {
+            fprintf(stderr, "usdVoxelConvert: no such file or directory '%s'\n", input.c_str());
+            return 1;
+        }
+    }
+
+    // e.g. foo.vox and foo.kvx in the same directory would both be written to foo.usdc, racing each other.
+    // The same file given twice (e.g. on its own and through its directory) is converted once.
+    std::map<std::string, std::string> outputInputs;
+    std::vector<ConvertJob> uniqueJobs;
+    for (const ConvertJob &job : jobs) {
+        auto inserted = outputInputs.emplace(job.output, job.input);
+        if (inserted.second) {
+            uniqueJobs.push_back(job);
+        } else if (TfNormPath(inserted.first->second) != TfNormPath(job.input)) {
+            fprintf(stderr, "usdVoxelConvert: '%s' and '%s' would both be converted to '%s'\n",
+                    inserted.first->second.c_str(), job.input.c_str(), job.output.c_str());
+            return 2;
+        }
+    }
+    jobs.swap(uniqueJobs);
+
+    std::mutex printMutex;
+    std::atomic<size_t> converted(0), skipped(0), failed(0);
+
+    // one file per task: files vary a lot in size
+    WorkParallelForN(jobs.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const ConvertJob &job = jobs[i];
+            std::string key;
+            bool ok = conversionKey(job.input, options, &key);
+            if (ok && !options.force && isUpToDate(job.output, key)) {
+                skipped++;
+                if (options.verbose) {
+                    std::lock_guard<std::mutex> lock(printMutex);
+                    printf("up to date: %s\n", job.output.c_str());
+                }
+                continue;
+            }
+            TfErrorMark mark;
+            ok = ok && convert(job, key, options) && mark.IsClean();
+            std::lock_guard<std::mutex> lock(printMutex);
+            if (ok) {
+                converted++;
+                if (options.verbose) {
+                    printf("converted: %s -> %s\n", job.input.c_str(), job.output.c_str());
+                }
+            } else {
+                failed++;
+                fprintf(stderr, "usdVoxelConvert: failed to convert '%s'\n", job.input.c_str());
+            }
+        }
+    }, 1);
+
+    printf("%zu converted, %zu up to date, %zu failed\n", converted.load(), skipped.load(), failed.load());
+    return failed ? 1 : 0;
+}